@@ -0,0 +1,274 @@
+#include "../src/urcl/source.h"
+#include "../src/urcl/config.h"
+
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <functional>
+#include <sstream>
+#include <string>
+#include <vector>
+
+// Times each analysis pass of urcl::source on generated programs, or checks the
+// lexer against token streams recorded from a known good build.
+// usage: urcl-lsp-bench [scale] [iterations]
+//        urcl-lsp-bench --lexer <file.urcl>...         compares with <file>.tokens
+//        urcl-lsp-bench --record-lexer <file.urcl>...  writes <file>.tokens
+
+struct corpus {
+    std::string name;
+    std::vector<std::string> lines;
+    lsp::Position reference; // a name with many uses
+    lsp::Position completion; // an operand to complete
+};
+
+static corpus arrays(unsigned int scale) {
+    corpus result{"dw arrays", {"BITS 16", "MINREG 8"}, {}, {}};
+    for (unsigned int i = 0; i < 100 * scale; ++i) {
+        result.lines.push_back(".data" + std::to_string(i));
+        std::string line = "DW [";
+        for (unsigned int k = 0; k < 64; ++k) {
+            line += ' ' + std::to_string((i * 64 + k) % 65536);
+        }
+        result.lines.push_back(line + " ]");
+        result.lines.push_back("LOD R1 .data" + std::to_string(i));
+    }
+    result.reference = {2, 0};
+    result.completion = {4, 8};
+    return result;
+}
+
+static corpus defines(unsigned int scale) {
+    corpus result{"define chains", {"BITS 16"}, {}, {}};
+    for (unsigned int chain = 0; chain < 10 * scale; ++chain) {
+        std::string prefix = "@C" + std::to_string(chain) + "_";
+        result.lines.push_back("@DEFINE " + prefix + "0 R1");
+        for (unsigned int depth = 1; depth < 50; ++depth) {
+            result.lines.push_back("@DEFINE " + prefix + std::to_string(depth) + ' ' + prefix + std::to_string(depth - 1));
+        }
+        for (unsigned int use = 0; use < 50; ++use) {
+            result.lines.push_back("ADD " + prefix + "49 " + prefix + std::to_string(use) + " 1");
+        }
+    }
+    result.reference = {1, 8};
+    result.completion = {51, 5};
+    return result;
+}
+
+static corpus labels(unsigned int scale) {
+    corpus result{"labels", {"BITS 16"}, {}, {}};
+    for (unsigned int i = 0; i < 1000 * scale; ++i) {
+        result.lines.push_back(".label" + std::to_string(i));
+        result.lines.push_back("ADD R1 R1 " + std::to_string(i));
+        result.lines.push_back("BRZ .label" + std::to_string((i * 7) % (1000 * scale)) + " R1");
+        result.lines.push_back("JMP .label0");
+    }
+    result.reference = {1, 0};
+    result.completion = {3, 5};
+    return result;
+}
+
+static corpus objects(unsigned int scale) {
+    corpus result{"sub-objects", {"BITS 16"}, {}, {}};
+    for (unsigned int i = 0; i < 200 * scale; ++i) {
+        result.lines.push_back("!!!object" + std::to_string(i));
+        result.lines.push_back("!entry" + std::to_string(i));
+        for (unsigned int k = 0; k < 4; ++k) {
+            // labels are global even inside a sub-object, so each object needs its own
+            std::string local = ".local" + std::to_string(i) + "_" + std::to_string(k);
+            result.lines.push_back(local);
+            result.lines.push_back("CAL !entry" + std::to_string((i + 1) % (200 * scale)));
+            result.lines.push_back("BNZ " + local + " R2");
+        }
+        result.lines.push_back("RET");
+        result.lines.push_back("!!");
+    }
+    result.reference = {2, 0};
+    result.completion = {4, 5};
+    return result;
+}
+
+static double time(unsigned int iterations, const std::function<void()>& run) {
+    std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+    for (unsigned int i = 0; i < iterations; ++i) {
+        run();
+    }
+    std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+    return elapsed.count() / iterations;
+}
+
+static void report(const char *phase, double seconds, size_t lines, size_t tokens) {
+    std::printf("  %-18s %10.3f ms %14.0f lines/s %14.0f tokens/s\n", phase, seconds * 1000, lines / seconds, tokens / seconds);
+}
+
+// the lexer reads these options, every combination of them is checked
+constexpr unsigned int LEXER_OPTIONS = 32;
+// iris, urcx, uir and registers without standard, what a file gets without a lsp.txt
+constexpr unsigned int DEFAULT_OPTIONS = 1 | 2 | 8 | 16;
+
+static urcl::config lexerConfig(const std::filesystem::path& file, unsigned int options) {
+    urcl::config config(file);
+    config.useIris = options & 1;
+    config.useUrcx = options & 2;
+    config.useStandard = options & 4;
+    config.useUir = options & 8;
+    config.useRegs = options & 16;
+    return config;
+}
+
+// every token of every line, one per output line
+static std::string lexed(const std::vector<std::string>& lines, const urcl::config& config) {
+    urcl::source source(lines, config);
+    std::string result;
+    char value[32];
+    for (urcl::line_number row = 0; row < lines.size(); ++row) {
+        result += std::to_string(row + 1) + '\n';
+        for (const urcl::token& token : source.getLineTokens(row)) {
+            // printed as a double so platforms where long double is wider agree
+            if (token.type == urcl::token::real) {
+                std::snprintf(value, sizeof(value), "%.17g", static_cast<double>(token.value.real));
+            } else {
+                std::snprintf(value, sizeof(value), "%lld", static_cast<long long>(token.value.literal));
+            }
+            result += '\t' + std::to_string(token.type) + '|' + token.original + '|' + token.strVal + '|' + value + '|' + token.parse_error + '|' + token.parse_warning + '\n';
+        }
+    }
+    return result;
+}
+
+static uint64_t fnv1a(const std::string& text) {
+    uint64_t hash = 0xcbf29ce484222325;
+    for (unsigned char c : text) {
+        hash = (hash ^ c) * 0x100000001b3;
+    }
+    return hash;
+}
+
+static std::vector<std::string> readLines(std::istream&& in) {
+    std::vector<std::string> lines;
+    std::string line;
+    while (std::getline(in, line)) {
+        lines.push_back(std::move(line));
+    }
+    return lines;
+}
+
+// a hash per combination of options, then the whole stream for the default options
+static std::string lexerRecording(const std::filesystem::path& file) {
+    std::vector<std::string> lines = readLines(std::ifstream(file, std::ios::binary));
+    std::string result;
+    char hash[64];
+    for (unsigned int options = 0; options < LEXER_OPTIONS; ++options) {
+        std::snprintf(hash, sizeof(hash), "options %u %016llx\n", options, static_cast<unsigned long long>(fnv1a(lexed(lines, lexerConfig(file, options)))));
+        result += hash;
+    }
+    return result + lexed(lines, lexerConfig(file, DEFAULT_OPTIONS));
+}
+
+static int checkLexer(int count, char *files[], bool record) {
+    int result = 0;
+    for (int i = 0; i < count; ++i) {
+        std::filesystem::path file = files[i];
+        std::filesystem::path recordingFile = std::filesystem::path(file).replace_extension(".tokens");
+        std::string actual = lexerRecording(file);
+        if (record) {
+            std::ofstream(recordingFile, std::ios::binary | std::ios::trunc) << actual;
+            std::printf("%s: recorded\n", file.string().c_str());
+            continue;
+        }
+        std::ifstream in(recordingFile, std::ios::binary);
+        if (!in.is_open()) {
+            std::fprintf(stderr, "%s: no recording\n", recordingFile.string().c_str());
+            result = 1;
+            continue;
+        }
+        std::stringstream expected;
+        expected << in.rdbuf();
+        if (expected.str() == actual) {
+            std::printf("%s: identical\n", file.string().c_str());
+            continue;
+        }
+        // report the first line that differs, the option hashes come first
+        std::vector<std::string> want = readLines(std::istringstream(expected.str()));
+        std::vector<std::string> got = readLines(std::istringstream(actual));
+        size_t row = 0;
+        while (row < want.size() && row < got.size() && want[row] == got[row]) {
+            ++row;
+        }
+        std::fprintf(stderr, "%s:%zu: token stream differs\n  recorded: %s\n  lexed:    %s\n", recordingFile.string().c_str(), row + 1,
+                     row < want.size() ? want[row].c_str() : "(end)", row < got.size() ? got[row].c_str() : "(end)");
+        result = 1;
+    }
+    return result;
+}
+
+int main(int argc, char *argv[]) {
+    if (argc > 1 && (!std::strcmp(argv[1], "--lexer") || !std::strcmp(argv[1], "--record-lexer"))) {
+        return checkLexer(argc - 2, argv + 2, !std::strcmp(argv[1], "--record-lexer"));
+    }
+
+    unsigned int scale = argc > 1 ? std::strtoul(argv[1], nullptr, 10) : 10;
+    unsigned int iterations = argc > 2 ? std::strtoul(argv[2], nullptr, 10) : 5;
+    if (scale == 0) scale = 1;
+    if (iterations == 0) iterations = 1;
+
+    const std::filesystem::path file = "bench.urcl";
+    const lsp::DocumentUri uri = lsp::FileUri::fromPath("/bench.urcl");
+    const urcl::config config(file);
+    const std::unordered_map<std::filesystem::path, std::shared_ptr<const urcl::source>> open;
+
+    for (const corpus& program : {arrays(scale), defines(scale), labels(scale), objects(scale)}) {
+        urcl::source source(program.lines, config);
+        source.updateReferences(open, config);
+        source.updateDefinitions(file, config);
+        source.updateErrors(config);
+        size_t lines = program.lines.size();
+        size_t tokens = source.getTokens().size() / 5;
+        // a corpus with errors would time the diagnostic paths instead of what it is named after
+        std::vector<lsp::Diagnostic> diagnostics = source.getDiagnostics();
+        if (!diagnostics.empty()) {
+            std::fprintf(stderr, "%s: %zu diagnostics, first on line %u: %s\n", program.name.c_str(), diagnostics.size(),
+                         diagnostics[0].range.start.line + 1, diagnostics[0].message.c_str());
+            return 1;
+        }
+        std::printf("%s: %zu lines, %zu tokens, %zu references, %zu completions\n", program.name.c_str(), lines, tokens,
+                    source.getReferences(program.reference, uri).size(), source.getCompletion(program.completion, config).size());
+
+        report("construct", time(iterations, [&] {
+            urcl::source parsed(program.lines, config);
+        }), lines, tokens);
+        // a fresh source per iteration, the passes only redo work for lines that changed
+        // built separately, copies would share their lines and time copying them on the first edit
+        std::vector<urcl::source> fresh;
+        fresh.reserve(iterations);
+        for (unsigned int i = 0; i < iterations; ++i) {
+            fresh.emplace_back(program.lines, config);
+            fresh.back().updateReferences(open, config);
+        }
+        size_t next = 0;
+        report("updateDefinitions", time(iterations, [&] {
+            fresh[next++].updateDefinitions(file, config);
+        }), lines, tokens);
+        next = 0;
+        report("updateErrors", time(iterations, [&] {
+            fresh[next++].updateErrors(config);
+        }), lines, tokens);
+        // what publishing a snapshot costs
+        report("copy", time(iterations, [&] {
+            urcl::source copy(source);
+        }), lines, tokens);
+        report("getTokens", time(iterations, [&] {
+            source.getTokens();
+        }), lines, tokens);
+        report("getReferences", time(iterations, [&] {
+            source.getReferences(program.reference, uri);
+        }), lines, tokens);
+        report("getCompletion", time(iterations, [&] {
+            source.getCompletion(program.completion, config);
+        }), lines, tokens);
+    }
+    return 0;
+}
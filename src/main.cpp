@@ -11,6 +11,14 @@
 
 #include "urcl/source.h"
 #include "urcl/config.h"
+#include "server/input.h"
+#include "server/check.h"
+#include "server/dependencies.h"
+#include "server/index.h"
+#include "server/progress.h"
+#include "server/documents.h"
+#include "server/snapshot.h"
+#include "stats.h"
 #include "util.h"
 
 typedef unsigned int uint;
@@ -64,22 +72,299 @@ std::vector<std::string> replaceRange(const std::vector<std::string> &str, lsp::
 
 bool running = false;
 
+// workspace/executeCommand that returns the --stats counters
+constexpr const char *STATS_COMMAND = "urcl.stats";
+// workspace/executeCommand that breaks down the memory held by every open document
+constexpr const char *MEMORY_COMMAND = "urcl.memory";
+
+// reports are also written to stderr so the numbers end up in the editor's log of the server
+lsp::json::Object statsReport() {
+    lsp::json::Object counters;
+    fprintf(stderr, "%-40s %10s %12s %12s %14s\n", "scope", "count", "total ms", "max ms", "bytes");
+    for (const std::pair<std::string, stats::counter>& counter : stats::counters()) {
+        double totalMs = counter.second.totalNs / 1e6;
+        double maxMs = counter.second.maxNs / 1e6;
+        counters[counter.first] = lsp::json::Object{
+            {"count", static_cast<double>(counter.second.count)},
+            {"totalMs", totalMs},
+            {"maxMs", maxMs},
+            {"bytes", static_cast<double>(counter.second.bytes)}
+        };
+        fprintf(stderr, "%-40s %10llu %12.3f %12.3f %14llu\n", counter.first.c_str(), static_cast<unsigned long long>(counter.second.count),
+                totalMs, maxMs, static_cast<unsigned long long>(counter.second.bytes));
+    }
+    return lsp::json::Object{{"enabled", stats::enabled.load()}, {"counters", counters}};
+}
+
+lsp::json::Object memoryObject(size_t text, const urcl::memory_usage& usage) {
+    fprintf(stderr, " %12zu %12zu %12zu %12zu %12zu %12zu %12zu\n", text, usage.tokens, usage.lines, usage.includes, usage.definitions, usage.dialect, text + usage.total());
+    return lsp::json::Object{
+        {"text", static_cast<double>(text)},
+        {"tokens", static_cast<double>(usage.tokens)},
+        {"lines", static_cast<double>(usage.lines)},
+        {"includes", static_cast<double>(usage.includes)},
+        {"definitions", static_cast<double>(usage.definitions)},
+        {"dialect", static_cast<double>(usage.dialect)},
+        {"total", static_cast<double>(text + usage.total())}
+    };
+}
+
+lsp::json::Object memoryReport(const server::documents& documents) {
+    lsp::json::Object perDocument;
+    urcl::memory_usage sum;
+    size_t sumText = 0;
+    // lines and includes shared between snapshots, working copies and includers are counted once
+    std::unordered_set<const void *> counted;
+    fprintf(stderr, "%-40s %12s %12s %12s %12s %12s %12s %12s\n", "document", "text", "tokens", "lines", "includes", "definitions", "dialect", "total");
+    for (server::handle handle : documents.all()) {
+        const server::document& document = documents[handle];
+        std::shared_ptr<const server::snapshot> snapshot = document.snapshot->load();
+        if (!snapshot) continue;
+        urcl::memory_usage usage;
+        // an included snapshot was already counted with the document including it
+        if (counted.insert(&snapshot->code).second) usage = snapshot->code.getMemoryUsage(counted);
+        // the working copy edits are applied to, only what it no longer shares with the snapshot; empty while it is analysed
+        usage += document.code.getMemoryUsage(counted);
+        // the editor's copy of the text, kept to apply incremental changes
+        size_t text = document.text.capacity() * sizeof(std::string);
+        for (const std::string& line : document.text) {
+            text += line.capacity();
+        }
+        fprintf(stderr, "%-40s", document.file.filename().string().c_str());
+        perDocument[document.file.string()] = memoryObject(text, usage);
+        sumText += text;
+        sum += usage;
+    }
+    fprintf(stderr, "%-40s", "all documents");
+    return lsp::json::Object{{"documents", perDocument}, {"total", memoryObject(sumText, sum)}};
+}
+
+lsp::json::Object positionObject(const lsp::Position& position) {
+    return lsp::json::Object{{"line", static_cast<lsp::json::Integer>(position.line)}, {"character", static_cast<lsp::json::Integer>(position.character)}};
+}
+
+// partial results are sent as $/progress values, which are plain JSON
+lsp::json::Object locationObject(const lsp::Location& location) {
+    lsp::json::Object range{{"start", positionObject(location.range.start)}, {"end", positionObject(location.range.end)}};
+    return lsp::json::Object{{"uri", location.uri.toString()}, {"range", range}};
+}
+
+lsp::SymbolInformation symbolInformation(const std::filesystem::path& file, const urcl::symbol& symbol) {
+    lsp::SymbolInformation result;
+    result.name = symbol.name;
+    result.kind = urcl::source::getSymbolKind(symbol.type);
+    result.location = lsp::Location{lsp::FileUri::fromPath(file.string()), symbol.range};
+    return result;
+}
+
 int main(int argc, char *argv[]) {
-    lsp::Connection connection = lsp::Connection(lsp::io::standardIO());
+    // batch mode for CI, everything after --check is a file or directory to analyse
+    for (int i = 1; i < argc; ++i) {
+        if (!strcmp(argv[i], "--check")) return server::check({argv + i + 1, argv + argc});
+    }
+
+    server::input input = server::input(lsp::io::standardIO());
+    lsp::Connection connection = lsp::Connection(input);
     lsp::MessageHandler messageHandler = lsp::MessageHandler(connection);
-    std::unordered_map<std::filesystem::path, urcl::source> code;
-    std::unordered_map<std::filesystem::path, urcl::config> config;
-    std::unordered_map<std::filesystem::path, std::vector<std::string>> documents;
+    // work that keeps the server busy without a request waiting on it, reported with $/progress when the editor supports it
+    server::progress loading("includes", "Loading includes", [&input]() {
+        input.wake();
+    });
+    server::progress reloading("config", "Reloading lsp.txt", [&input]() {
+        input.wake();
+    });
+    server::progress indexed("index", "Indexing workspace", [&input]() {
+        input.wake();
+    });
+    // every open document, requests look their URI up once and use the handle from then on
+    server::documents documents;
+    // open documents that include each file
+    server::dependencies dependencies;
+    bool watchFiles = false;
+    // the client asks for diagnostics itself, so they are never pushed
+    bool pullDiagnostics = false;
+    // a pulling client can be asked to pull again, analyses it didn't ask for set refresh until the loop is idle
+    bool refreshDiagnostics = false;
+    bool refresh = false;
+    // definitions of files that aren't open, only filled when indexing is enabled
+    server::index workspace;
+    bool indexing = false;
+    std::filesystem::path cacheFile = server::cache::location();
+    // takes the working copy of one document at a time, the main loop keeps answering requests meanwhile
+    server::analyser analyser(loading, [&input]() {
+        input.wake();
+    });
+
+    auto find = [&documents](const lsp::DocumentUri& uri) {
+        return documents.find(std::filesystem::path(uri.path()));
+    };
+    // the working copy has to be back before it is edited or analysed on this thread
+    auto reclaim = [&documents, &analyser](server::handle handle) {
+        server::document& document = documents[handle];
+        if (!analyser.analysing(document.file)) return;
+        std::optional<server::analysis> done = analyser.collect(true);
+        document.code = std::move(done->code);
+    };
+    // the open documents a file includes, so they don't have to be read from disk
+    auto openIncludes = [&documents, &analyser](server::handle handle) {
+        std::unordered_map<std::filesystem::path, std::shared_ptr<const urcl::source>> open;
+        for (const std::filesystem::path& include : documents[handle].config.includes) {
+            for (server::handle other : documents.all()) {
+                const server::document& document = documents[other];
+                std::error_code error;
+                if (!std::filesystem::equivalent(include, document.file, error)) continue;
+                std::shared_ptr<const server::snapshot> snapshot = document.snapshot->load();
+                if (snapshot) {
+                    // shares the snapshot instead of copying it, the include keeps it alive
+                    open.emplace(document.file, std::shared_ptr<const urcl::source>(snapshot, &snapshot->code));
+                } else if (!analyser.analysing(document.file)) {
+                    open.emplace(document.file, std::make_shared<const urcl::source>(document.code));
+                }
+            }
+        }
+        return open;
+    };
+    // documents rebuilt because their lsp.txt changed count towards the reload progress once they are analysed
+    auto reloaded = [&documents, &reloading](server::handle handle) {
+        server::document& document = documents[handle];
+        if (!document.reloading) return;
+        size_t bytes = 0;
+        for (const std::string& line : document.text) {
+            bytes += line.size() + 1;
+        }
+        reloading.done(bytes);
+        document.reloading = false;
+    };
+    auto analyse = [&documents, &loading, &reclaim, &openIncludes, &reloaded](server::handle handle) {
+        reclaim(handle);
+        server::document& document = documents[handle];
+        // includes only have to be loaded again when the source was rebuilt, edits keep the previous results
+        if (document.unanalysed) {
+            loading.expect(document.config.includes.size());
+            document.code.updateReferences(openIncludes(handle), document.config, [&loading](size_t bytes) {
+                loading.done(bytes);
+            });
+        }
+        document.code.updateDefinitions(document.file, document.config);
+        document.code.updateErrors(document.config);
+        document.unanalysed = false;
+        document.stale = false;
+        reloaded(handle);
+        return server::publish(*document.snapshot, document.version, document.config, document.code);
+    };
+    // hands the working copy to the analyser, the previous snapshot stays readable until the new one is published
+    auto analyseInBackground = [&documents, &analyser, &openIncludes](server::handle handle) {
+        server::document& document = documents[handle];
+        std::unordered_map<std::filesystem::path, std::shared_ptr<const urcl::source>> open;
+        if (document.unanalysed) open = openIncludes(handle);
+        analyser.start(server::analysis{document.file, document.version, document.config, std::move(document.code), document.unanalysed, std::move(open), document.snapshot});
+        document.unanalysed = false;
+        document.stale = false;
+    };
+    // newest snapshot, which may be a few edits behind; only a document that was never analysed is analysed first
+    auto latest = [&documents, &analyse](server::handle handle) {
+        std::shared_ptr<const server::snapshot> snapshot = documents[handle].snapshot->load();
+        if (!snapshot) snapshot = analyse(handle);
+        return snapshot;
+    };
+    // snapshot of the text the editor has now, for requests that act on what was just typed
+    auto current = [&documents, &reclaim, &analyse](server::handle handle) {
+        // edits wait for an analysis in progress, so a running analysis is always of the latest version
+        reclaim(handle);
+        const server::document& document = documents[handle];
+        std::shared_ptr<const server::snapshot> snapshot = document.snapshot->load();
+        if (!snapshot || document.unanalysed || document.stale) snapshot = analyse(handle);
+        return snapshot;
+    };
+    auto report = [&messageHandler](server::progress& task) {
+        std::optional<server::progress_report> next = task.poll();
+        if (!next.has_value()) return;
+        if (next->create) {
+            messageHandler.sendRequest<lsp::requests::Window_WorkDoneProgress_Create>({next->token}, [](auto&&...) {}, [](auto&&...) {});
+        }
+        messageHandler.sendNotification<lsp::notifications::Progress>({next->token, next->value});
+    };
+    auto publishDiagnostics = [&documents, &messageHandler, &latest, &pullDiagnostics, &refreshDiagnostics, &refresh](server::handle handle, const lsp::DocumentUri& uri) {
+        if (pullDiagnostics) {
+            // the client only pulls after its own edits, a changed include or lsp.txt has to be announced
+            std::shared_ptr<const server::snapshot> snapshot = documents[handle].snapshot->load();
+            if (refreshDiagnostics && snapshot && snapshot->serial != documents[handle].pushed) refresh = true;
+            return;
+        }
+        stats::scope scope("publishDiagnostics");
+        scope.document(documents[handle].file, documents[handle].version);
+        std::shared_ptr<const server::snapshot> snapshot = latest(handle);
+        // the client already has the diagnostics of this analysis
+        if (snapshot->serial == documents[handle].pushed) return;
+        documents[handle].pushed = snapshot->serial;
+        lsp::notifications::TextDocument_PublishDiagnostics::Params errorParam{uri, snapshot->code.getDiagnostics()};
+        messageHandler.sendNotification<lsp::notifications::TextDocument_PublishDiagnostics>(std::move(errorParam));
+    };
+    auto configure = [&documents, &dependencies](server::handle handle) {
+        server::document& document = documents[handle];
+        document.config = document.file;
+        dependencies.update(document.file, document.config.includes);
+    };
+    // documents including a changed file load it again the next time they are analysed
+    auto invalidateDependents = [&documents, &dependencies](const std::filesystem::path& file) {
+        for (const std::filesystem::path& dependent : dependencies.dependents(file)) {
+            server::handle handle = documents.find(dependent);
+            if (handle != server::NO_DOCUMENT) documents[handle].unanalysed = true;
+        }
+    };
 
     const char *escaped = "escape";
     for (int i = 1; i < argc; ++i) {
         if (!strcmp(argv[i], "--no-escape")) {
             escaped = "string";
+        } else if (!strcmp(argv[i], "--index")) {
+            indexing = true;
+        } else if (!strcmp(argv[i], "--no-index-cache")) {
+            cacheFile.clear();
+        } else if (!strcmp(argv[i], "--record") && i + 1 < argc) {
+            if (!input.record(argv[++i])) {
+                fprintf(stderr, "Could not open %s for recording\n", argv[i]);
+            }
+        } else if (!strcmp(argv[i], "--stats")) {
+            stats::enabled = true;
+        } else if (!strcmp(argv[i], "--trace") && i + 1 < argc) {
+            if (!stats::trace(argv[++i])) {
+                fprintf(stderr, "Could not open %s for tracing\n", argv[i]);
+            }
         }
     }
 
     messageHandler.add<lsp::requests::Initialize>(
-        [escaped](lsp::requests::Initialize::Params&&) {
+        [escaped, &watchFiles, &pullDiagnostics, &refreshDiagnostics, &workspace, indexing, &cacheFile, &loading, &reloading, &indexed](lsp::requests::Initialize::Params&& params) {
+            stats::scope scope("initialize");
+            if (params.capabilities.workspace && params.capabilities.workspace->didChangeWatchedFiles) {
+                watchFiles = params.capabilities.workspace->didChangeWatchedFiles->dynamicRegistration.value_or(false);
+            }
+            pullDiagnostics = params.capabilities.textDocument && params.capabilities.textDocument->diagnostic;
+            if (params.capabilities.workspace && params.capabilities.workspace->diagnostics) {
+                refreshDiagnostics = params.capabilities.workspace->diagnostics->refreshSupport.value_or(false);
+            }
+            if (params.capabilities.window && params.capabilities.window->workDoneProgress.value_or(false)) {
+                loading.enable();
+                reloading.enable();
+                indexed.enable();
+            }
+            if (indexing) {
+                std::vector<std::filesystem::path> folders;
+                if (params.workspaceFolders.has_value() && !params.workspaceFolders->isNull()) {
+                    for (const lsp::WorkspaceFolder& folder : params.workspaceFolders->value()) {
+                        folders.push_back(folder.uri.path());
+                    }
+                } else if (!params.rootUri.isNull()) {
+                    folders.push_back(params.rootUri->path());
+                }
+                // a quarter of the cores, interactive requests keep the rest
+                workspace.start(folders, std::max(1u, std::thread::hardware_concurrency() / 4), cacheFile, indexed);
+            }
+            lsp::DiagnosticOptions diagnostics;
+            // a document is diagnosed with the definitions of its includes
+            diagnostics.interFileDependencies = true;
+            diagnostics.workspaceDiagnostics = true;
             return lsp::requests::Initialize::Result{
                 .capabilities = {
                     .positionEncoding = lsp::PositionEncodingKind::UTF16,
@@ -88,8 +373,12 @@ int main(int argc, char *argv[]) {
                     .hoverProvider = true,
                     .definitionProvider = true,
                     .referencesProvider = true,
+                    .documentSymbolProvider = true,
+                    .workspaceSymbolProvider = true,
                     .foldingRangeProvider = true,
-                    .semanticTokensProvider = lsp::SemanticTokensOptions(false, {{"keyword", "variable", "number", "function", "comment", "class", "operator", "macro", "string", escaped, "operator", "namespace"}, {}}, false, true)
+                    .executeCommandProvider = lsp::ExecuteCommandOptions{{}, {STATS_COMMAND, MEMORY_COMMAND}},
+                    .semanticTokensProvider = lsp::SemanticTokensOptions(false, {{"keyword", "variable", "number", "function", "comment", "class", "operator", "macro", "string", escaped, "operator", "namespace"}, {}}, true, true),
+                    .diagnosticProvider = diagnostics
                 },
                 .serverInfo = lsp::InitializeResultServerInfo{
                     .name    = "URCL Language Server",
@@ -97,78 +386,142 @@ int main(int argc, char *argv[]) {
                 }
             };
         }
+    ).add<lsp::notifications::Initialized>(
+        [&watchFiles, &messageHandler](lsp::notifications::Initialized::Params&&) {
+            stats::scope scope("initialized");
+            if (!watchFiles) return;
+            lsp::json::Array watchers;
+            for (const char *pattern : {"**/lsp.txt", "**/*.urcl", "**/*.uir"}) {
+                watchers.push_back(lsp::json::Object{{"globPattern", pattern}});
+            }
+            lsp::RegistrationParams registration{{lsp::Registration{"watched-files", "workspace/didChangeWatchedFiles", lsp::json::Object{{"watchers", watchers}}}}};
+            // lsp.txt lookups can be cached once the client reports created and deleted ones
+            messageHandler.sendRequest<lsp::requests::Client_RegisterCapability>(std::move(registration), [](auto&&...) {
+                urcl::config::watch(true);
+            }, [](auto&&...) {});
+        }
     ).add<lsp::notifications::TextDocument_DidOpen>(
-        [&code, &config, &documents](lsp::notifications::TextDocument_DidOpen::Params&& params) {
-            std::vector<std::string> document = splitString(params.textDocument.text);
-            std::filesystem::path str = params.textDocument.uri.path();
-            config.emplace(str, str);
-            code.emplace(str, urcl::source(document, config.at(str)));
-            code[str].updateReferences(code, config[str]);
-            code[str].updateDefinitions(str, config[str]);
-            code[str].updateErrors(config[str]);
-            documents[str] = std::move(document);
+        [&documents, &reclaim, &configure](lsp::notifications::TextDocument_DidOpen::Params&& params) {
+            stats::scope scope("textDocument/didOpen");
+            std::vector<std::string> text = splitString(params.textDocument.text);
+            server::handle handle = documents.open(params.textDocument.uri.path());
+            reclaim(handle);
+            server::document& document = documents[handle];
+            document.version = params.textDocument.version;
+            scope.document(document.file, document.version);
+            configure(handle);
+            document.code = urcl::source(text, document.config);
+            document.unanalysed = true;
+            document.text = std::move(text);
         }
     ).add<lsp::notifications::TextDocument_DidClose>(
-        [&code, &config, &documents](lsp::notifications::TextDocument_DidClose::Params&& params) {
-            std::filesystem::path str = params.textDocument.uri.path();
-            code.erase(str);
-            config.erase(str);
-            documents.erase(str);
+        [&documents, &dependencies, &find, &reclaim, &reloaded](lsp::notifications::TextDocument_DidClose::Params&& params) {
+            stats::scope scope("textDocument/didClose");
+            server::handle handle = find(params.textDocument.uri);
+            if (handle == server::NO_DOCUMENT) return;
+            scope.document(documents[handle].file, documents[handle].version);
+            reclaim(handle);
+            reloaded(handle);
+            dependencies.remove(documents[handle].file);
+            documents.close(handle);
         }
     ).add<lsp::notifications::TextDocument_DidSave>(
-        [&code, &config, &documents, &messageHandler](lsp::notifications::TextDocument_DidSave::Params&& params) {
-            std::filesystem::path str = params.textDocument.uri.path();
-            config[str] = str;
+        [&documents, &find, &reclaim, &analyse, &configure, &invalidateDependents, &workspace, &publishDiagnostics](lsp::notifications::TextDocument_DidSave::Params&& params) {
+            stats::scope scope("textDocument/didSave");
+            server::handle handle = find(params.textDocument.uri);
+            if (handle == server::NO_DOCUMENT) return;
+            server::document& document = documents[handle];
+            scope.document(document.file, document.version);
+            reclaim(handle);
+            configure(handle);
 
-            code[str] = urcl::source(documents[str], config[str]);
-            code[str].updateReferences(code, config[str]);
-            code[str].updateDefinitions(str, config[str]);
-            code[str].updateErrors(config[str]);
-            lsp::notifications::TextDocument_PublishDiagnostics::Params errorParam{params.textDocument.uri, code[str].getDiagnostics()};
-            messageHandler.sendNotification<lsp::notifications::TextDocument_PublishDiagnostics>(std::move(errorParam));
+            document.code = urcl::source(document.text, document.config);
+            document.unanalysed = true;
+            std::shared_ptr<const server::snapshot> snapshot = analyse(handle);
+            invalidateDependents(document.file);
+            workspace.update(document.file, snapshot->code.getSymbols());
+            publishDiagnostics(handle, params.textDocument.uri);
         }
     ).add<lsp::notifications::TextDocument_DidChange>(
-        [&code, &config, &documents](lsp::notifications::TextDocument_DidChange::Params&& params) {
+        [&documents, &find, &reclaim](lsp::notifications::TextDocument_DidChange::Params&& params) {
+            stats::scope scope("textDocument/didChange");
+            server::handle handle = find(params.textDocument.uri);
+            if (handle == server::NO_DOCUMENT) return;
+            server::document& document = documents[handle];
+            document.version = params.textDocument.version;
+            scope.document(document.file, document.version);
+            reclaim(handle);
             for (lsp::TextDocumentContentChangeEvent change : params.contentChanges) {
-                std::filesystem::path str = params.textDocument.uri.path();
                 if (std::holds_alternative<lsp::TextDocumentContentChangeEvent_Text>(change)) {
                     lsp::TextDocumentContentChangeEvent_Text fullChange = std::get<lsp::TextDocumentContentChangeEvent_Text>(change);
-                    std::vector<std::string> document = splitString(fullChange.text);
-                    code[str] = urcl::source(document, config[str]);
-                    code[str].updateReferences(code, config[str]);
-                    code[str].updateDefinitions(str, config[str]);
-                    code[str].updateErrors(config[str]);
-                    documents[str] = std::move(document);
+                    std::vector<std::string> text = splitString(fullChange.text);
+                    document.code = urcl::source(text, document.config);
+                    document.unanalysed = true;
+                    document.text = std::move(text);
                 } else {
                     lsp::TextDocumentContentChangeEvent_Range_Text rangeChange = std::get<lsp::TextDocumentContentChangeEvent_Range_Text>(change);
                     std::vector<std::string> newContents = splitString(rangeChange.text);
-                    documents[str] = replaceRange(documents[str], rangeChange.range, newContents);
-                    code[str] = urcl::source(documents[str], config[str]);
-                    code[str].updateReferences(code, config[str]);
-                    code[str].updateDefinitions(str, config[str]);
-                    code[str].updateErrors(config[str]);
+                    document.text = replaceRange(document.text, rangeChange.range, newContents);
+                    // only the replaced lines are lexed again, analysis then rechecks the lines that depend on them
+                    uint count = std::max<uint>(1, newContents.size());
+                    document.code.update(document.text, rangeChange.range.start.line, rangeChange.range.end.line + 1, count, document.config);
                 }
             }
+            // analysis waits until no more messages are queued, so a burst of typing is analysed once
+            document.stale = true;
         }
     ).add<lsp::requests::TextDocument_SemanticTokens_Full>(
-        [&code, &messageHandler](lsp::requests::TextDocument_SemanticTokens_Full::Params&& params) {
-            std::filesystem::path str = params.textDocument.uri.path();
-            std::vector<uint> tokens = code[str].getTokens();
+        [&documents, &find, &current, &publishDiagnostics](lsp::requests::TextDocument_SemanticTokens_Full::Params&& params) {
+            stats::scope scope("textDocument/semanticTokens/full");
+            server::handle handle = find(params.textDocument.uri);
+            if (handle == server::NO_DOCUMENT) return lsp::requests::TextDocument_SemanticTokens_Full::Result{};
+            scope.document(documents[handle].file, documents[handle].version);
+            std::vector<uint> tokens = current(handle)->code.getTokens();
 
-            lsp::notifications::TextDocument_PublishDiagnostics::Params errorParam{params.textDocument.uri, code[str].getDiagnostics()};
-            messageHandler.sendNotification<lsp::notifications::TextDocument_PublishDiagnostics>(std::move(errorParam));
+            publishDiagnostics(handle, params.textDocument.uri);
             return lsp::requests::TextDocument_SemanticTokens_Full::Result {{tokens}};
         }
+    ).add<lsp::requests::TextDocument_SemanticTokens_Range>(
+        [&documents, &analyser, &find, &reclaim](lsp::requests::TextDocument_SemanticTokens_Range::Params&& params) {
+            stats::scope scope("textDocument/semanticTokens/range");
+            // answered straight from the lexed lines, defines only resolve once the document has been analysed
+            server::handle handle = find(params.textDocument.uri);
+            if (handle == server::NO_DOCUMENT) return lsp::requests::TextDocument_SemanticTokens_Range::Result{};
+            const server::document& document = documents[handle];
+            scope.document(document.file, document.version);
+            // while the working copy is being analysed the previous snapshot is close enough
+            std::shared_ptr<const server::snapshot> snapshot = analyser.analysing(document.file) ? document.snapshot->load() : nullptr;
+            if (!snapshot) reclaim(handle);
+            std::vector<uint> tokens = snapshot ? snapshot->code.getTokens(params.range) : document.code.getTokens(params.range);
+            return lsp::requests::TextDocument_SemanticTokens_Range::Result {{tokens}};
+        }
     ).add<lsp::requests::TextDocument_Definition>(
-        [&code](lsp::requests::TextDocument_Definition::Params&& params) {
-            std::filesystem::path str = params.textDocument.uri.path();
+        [&documents, &find, &latest, &workspace](lsp::requests::TextDocument_Definition::Params&& params) {
+            stats::scope scope("textDocument/definition");
             lsp::requests::TextDocument_Definition::Result result;
-            std::optional<lsp::Location> loc = code[str].getDefinitionRange(params.position, str);
+            server::handle handle = find(params.textDocument.uri);
+            if (handle == server::NO_DOCUMENT) {
+                result = nullptr;
+                return result;
+            }
+            const std::filesystem::path& str = documents[handle].file;
+            scope.document(str, documents[handle].version);
+            std::shared_ptr<const server::snapshot> snapshot = latest(handle);
+            std::optional<lsp::Location> loc = snapshot->code.getDefinitionRange(params.position, str);
+            const urcl::token *token = snapshot->code.getToken(params.position);
+            if (!loc.has_value() && token && token->type != urcl::token::label) {
+                // not defined by the document or its includes, fall back to the rest of the workspace
+                for (const std::pair<std::filesystem::path, urcl::symbol>& found : workspace.find(token->original)) {
+                    if (found.first == str) continue;
+                    loc = lsp::Location{lsp::FileUri::fromPath(found.first.string()), found.second.range};
+                    break;
+                }
+            }
             if (!loc.has_value()) {
                 result = nullptr;
                 return result;
             }
-            std::optional<lsp::Range> sourceRange = code[str].getTokenRange(params.position);
+            std::optional<lsp::Range> sourceRange = snapshot->code.getTokenRange(params.position);
             if (!sourceRange.has_value()) {
                 result = {loc.value()};
                 return result;
@@ -177,28 +530,188 @@ int main(int argc, char *argv[]) {
             return result;
         }
     ).add<lsp::requests::TextDocument_FoldingRange>(
-        [&code](lsp::requests::TextDocument_FoldingRange::Params&& params) {
-            std::filesystem::path str = params.textDocument.uri.path();
-            return lsp::requests::TextDocument_FoldingRange::Result{code[str].getFoldingRanges()};
+        [&documents, &find, &latest](lsp::requests::TextDocument_FoldingRange::Params&& params) {
+            stats::scope scope("textDocument/foldingRange");
+            server::handle handle = find(params.textDocument.uri);
+            if (handle == server::NO_DOCUMENT) return lsp::requests::TextDocument_FoldingRange::Result{};
+            scope.document(documents[handle].file, documents[handle].version);
+            return lsp::requests::TextDocument_FoldingRange::Result{latest(handle)->code.getFoldingRanges()};
         }
     ).add<lsp::requests::TextDocument_Completion>(
-        [&code, &config](lsp::requests::TextDocument_Completion::Params&& params) {
-            std::filesystem::path str = params.textDocument.uri.path();
+        [&documents, &find, &current](lsp::requests::TextDocument_Completion::Params&& params) {
+            stats::scope scope("textDocument/completion");
+            server::handle handle = find(params.textDocument.uri);
+            if (handle == server::NO_DOCUMENT) return lsp::requests::TextDocument_Completion::Result{};
+            scope.document(documents[handle].file, documents[handle].version);
+            // completion usually follows a keystroke, so it has to see that edit
+            std::shared_ptr<const server::snapshot> snapshot = current(handle);
 
-            std::vector<lsp::CompletionItem> result = code[str].getCompletion(params.position, config[str]);
+            std::vector<lsp::CompletionItem> result = snapshot->code.getCompletion(params.position, snapshot->config);
             return lsp::requests::TextDocument_Completion::Result{result};
         }
     ).add<lsp::requests::TextDocument_Hover>(
-        [&code, &config](lsp::requests::TextDocument_Hover::Params&& params) {
-            std::filesystem::path str = params.textDocument.uri.path();
-            std::optional<std::string> hover = code[str].getHover(params.position, config[str]);
+        [&documents, &find, &latest](lsp::requests::TextDocument_Hover::Params&& params) {
+            stats::scope scope("textDocument/hover");
+            server::handle handle = find(params.textDocument.uri);
+            if (handle == server::NO_DOCUMENT) return lsp::requests::TextDocument_Hover::Result{};
+            scope.document(documents[handle].file, documents[handle].version);
+            std::shared_ptr<const server::snapshot> snapshot = latest(handle);
+            std::optional<std::string> hover = snapshot->code.getHover(params.position, snapshot->config);
             if (!hover.has_value()) return lsp::requests::TextDocument_Hover::Result{};
-            return lsp::requests::TextDocument_Hover::Result{{hover->data(), code[str].getTokenRange(params.position)}};
+            return lsp::requests::TextDocument_Hover::Result{{hover->data(), snapshot->code.getTokenRange(params.position)}};
         }
     ).add<lsp::requests::TextDocument_References>(
-        [&code](lsp::requests::TextDocument_References::Params&& params) {
-            std::filesystem::path str = params.textDocument.uri.path();
-            return lsp::requests::TextDocument_References::Result{code[str].getReferences(params.position, params.textDocument.uri)};
+        [&documents, &find, &latest, &input, &messageHandler](lsp::requests::TextDocument_References::Params&& params) {
+            stats::scope scope("textDocument/references");
+            server::handle handle = find(params.textDocument.uri);
+            if (handle == server::NO_DOCUMENT) return lsp::requests::TextDocument_References::Result{};
+            scope.document(documents[handle].file, documents[handle].version);
+            std::string id = input.request();
+            std::vector<lsp::Location> result;
+            // with a partial result token every file is sent as soon as it has been searched and the reply stays empty,
+            // a cancellation waiting in the queue stops the search and returns what was found so far
+            latest(handle)->code.getReferences(params.position, params.textDocument.uri, [&params, &id, &result, &input, &messageHandler](std::vector<lsp::Location>&& batch) {
+                if (!params.partialResultToken.has_value()) {
+                    result.insert(result.end(), std::make_move_iterator(batch.begin()), std::make_move_iterator(batch.end()));
+                } else if (!batch.empty()) {
+                    lsp::json::Array locations;
+                    for (const lsp::Location& location : batch) {
+                        locations.push_back(locationObject(location));
+                    }
+                    messageHandler.sendNotification<lsp::notifications::Progress>({*params.partialResultToken, locations});
+                }
+                return !input.cancelled(id);
+            });
+            return lsp::requests::TextDocument_References::Result{result};
+        }
+    ).add<lsp::requests::TextDocument_DocumentSymbol>(
+        [&documents, &find, &latest](lsp::requests::TextDocument_DocumentSymbol::Params&& params) {
+            stats::scope scope("textDocument/documentSymbol");
+            server::handle handle = find(params.textDocument.uri);
+            if (handle == server::NO_DOCUMENT) return lsp::requests::TextDocument_DocumentSymbol::Result{};
+            scope.document(documents[handle].file, documents[handle].version);
+            return lsp::requests::TextDocument_DocumentSymbol::Result{latest(handle)->code.getDocumentSymbols()};
+        }
+    ).add<lsp::requests::TextDocument_Diagnostic>(
+        [&documents, &find, &current](lsp::requests::TextDocument_Diagnostic::Params&& params) {
+            stats::scope scope("textDocument/diagnostic");
+            server::handle handle = find(params.textDocument.uri);
+            if (handle == server::NO_DOCUMENT) return lsp::requests::TextDocument_Diagnostic::Result{lsp::RelatedFullDocumentDiagnosticReport{}};
+            scope.document(documents[handle].file, documents[handle].version);
+            std::shared_ptr<const server::snapshot> snapshot = current(handle);
+            documents[handle].pushed = snapshot->serial;
+            std::string resultId = snapshot->resultId();
+            if (params.previousResultId == resultId) {
+                lsp::RelatedUnchangedDocumentDiagnosticReport unchanged;
+                unchanged.resultId = resultId;
+                return lsp::requests::TextDocument_Diagnostic::Result{unchanged};
+            }
+            lsp::RelatedFullDocumentDiagnosticReport full;
+            full.resultId = resultId;
+            full.items = snapshot->code.getDiagnostics();
+            return lsp::requests::TextDocument_Diagnostic::Result{full};
+        }
+    ).add<lsp::requests::Workspace_Diagnostic>(
+        [&documents, &latest](lsp::requests::Workspace_Diagnostic::Params&& params) {
+            stats::scope scope("workspace/diagnostic");
+            std::unordered_map<std::string, std::string> previous;
+            for (const lsp::PreviousResultId& id : params.previousResultIds) {
+                previous.emplace(id.uri.path(), id.value);
+            }
+            // only open documents are diagnosed, anything else would mean analysing the whole workspace
+            lsp::WorkspaceDiagnosticReport result;
+            for (server::handle handle : documents.all()) {
+                std::shared_ptr<const server::snapshot> snapshot = latest(handle);
+                documents[handle].pushed = snapshot->serial;
+                lsp::DocumentUri uri = lsp::FileUri::fromPath(documents[handle].file.string());
+                std::string resultId = snapshot->resultId();
+                auto found = previous.find(documents[handle].file.string());
+                if (found != previous.end() && found->second == resultId) {
+                    lsp::WorkspaceUnchangedDocumentDiagnosticReport unchanged;
+                    unchanged.resultId = resultId;
+                    unchanged.uri = uri;
+                    unchanged.version = static_cast<lsp::json::Integer>(snapshot->version);
+                    result.items.push_back(unchanged);
+                    continue;
+                }
+                lsp::WorkspaceFullDocumentDiagnosticReport full;
+                full.resultId = resultId;
+                full.items = snapshot->code.getDiagnostics();
+                full.uri = uri;
+                full.version = static_cast<lsp::json::Integer>(snapshot->version);
+                result.items.push_back(std::move(full));
+            }
+            return result;
+        }
+    ).add<lsp::requests::Workspace_Symbol>(
+        [&documents, &workspace](lsp::requests::Workspace_Symbol::Params&& params) {
+            stats::scope scope("workspace/symbol");
+            std::vector<server::match> matches;
+            for (server::handle handle : documents.all()) {
+                // documents that haven't been analysed yet have no symbols to offer
+                std::shared_ptr<const server::snapshot> snapshot = documents[handle].snapshot->load();
+                if (!snapshot) continue;
+                for (urcl::symbol& symbol : snapshot->code.getSymbols()) {
+                    int rank = server::index::rank(symbol.name, params.query);
+                    if (rank >= 0) matches.push_back({documents[handle].file, std::move(symbol), rank});
+                }
+            }
+            // open documents are newer than what the index read from disk
+            std::vector<server::match> indexed = workspace.search(params.query, server::MAX_WORKSPACE_SYMBOLS, [&documents](const std::filesystem::path& file) {
+                return documents.find(file) != server::NO_DOCUMENT;
+            });
+            matches.insert(matches.end(), std::make_move_iterator(indexed.begin()), std::make_move_iterator(indexed.end()));
+            server::index::best(matches, server::MAX_WORKSPACE_SYMBOLS);
+
+            std::vector<lsp::SymbolInformation> result;
+            result.reserve(matches.size());
+            for (const server::match& match : matches) {
+                result.push_back(symbolInformation(match.file, match.symbol));
+            }
+            return lsp::requests::Workspace_Symbol::Result{result};
+        }
+    ).add<lsp::notifications::Workspace_DidChangeWatchedFiles>(
+        [&documents, &reloading, &reclaim, &configure, &invalidateDependents, &workspace](lsp::notifications::Workspace_DidChangeWatchedFiles::Params&& params) {
+            stats::scope scope("workspace/didChangeWatchedFiles");
+            for (const lsp::FileEvent& change : params.changes) {
+                std::filesystem::path file = change.uri.path();
+                urcl::config::invalidate(file);
+                if (file.extension() == ".urcl" || file.extension() == ".uir") {
+                    if (change.type == lsp::FileChangeType::Deleted) {
+                        workspace.remove(file);
+                    } else {
+                        workspace.enqueue(file);
+                    }
+                }
+                if (file.filename() != "lsp.txt") {
+                    invalidateDependents(file);
+                    continue;
+                }
+                // options and includes of every open document below the changed lsp.txt may be different now
+                std::filesystem::path directory = file.parent_path();
+                for (server::handle handle : documents.all()) {
+                    server::document& document = documents[handle];
+                    auto relative = document.file.lexically_relative(directory);
+                    if (relative.empty() || *relative.begin() == "..") continue;
+                    reclaim(handle);
+                    configure(handle);
+                    document.code = urcl::source(document.text, document.config);
+                    document.unanalysed = true;
+                    if (!document.reloading) reloading.expect(1);
+                    document.reloading = true;
+                }
+            }
+        }
+    ).add<lsp::requests::Workspace_ExecuteCommand>(
+        [&documents](lsp::requests::Workspace_ExecuteCommand::Params&& params) {
+            stats::scope scope("workspace/executeCommand");
+            lsp::requests::Workspace_ExecuteCommand::Result result = nullptr;
+            if (params.command == STATS_COMMAND) {
+                result = statsReport();
+            } else if (params.command == MEMORY_COMMAND) {
+                result = memoryReport(documents);
+            }
+            return result;
         }
     ).add<lsp::requests::Shutdown>(
         [](){
@@ -211,9 +724,47 @@ int main(int argc, char *argv[]) {
     );
     
     running = true;
+    // work is done in priority order: queued messages, which the input already sorts so completion, hover and definition
+    // run ahead of semantic tokens and diagnostics, then analysis of edited documents, then loading the includes of
+    // opened documents, and indexing only runs on its worker threads while nothing else is waiting
     while (running) {
-        messageHandler.processIncomingMessages();
+        if (input.pending()) {
+            // indexing waits until the message has been answered
+            workspace.throttle(true);
+            messageHandler.processIncomingMessages();
+            continue;
+        }
+        workspace.throttle(false);
+        report(loading);
+        report(reloading);
+        report(indexed);
+        std::optional<server::analysis> done = analyser.collect(false);
+        server::handle next = server::NO_DOCUMENT;
+        if (!done.has_value() && analyser.idle()) {
+            // every queued edit has been applied, so edited documents go first, then the whole-file analysis of opened ones
+            next = documents.find([](const server::document& document) { return document.stale; });
+            if (next == server::NO_DOCUMENT) next = documents.find([](const server::document& document) { return document.unanalysed; });
+        }
+        if (done.has_value()) {
+            // the working copy comes back for the next edits, the editor gets the new snapshot's diagnostics
+            server::handle handle = documents.find(done->file);
+            documents[handle].code = std::move(done->code);
+            reloaded(handle);
+            publishDiagnostics(handle, lsp::FileUri::fromPath(done->file.string()));
+        } else if (input.closed()) {
+            break;
+        } else if (next != server::NO_DOCUMENT) {
+            analyseInBackground(next);
+        } else if (refresh) {
+            // once for every document analysed since the last refresh
+            refresh = false;
+            messageHandler.sendRequest<lsp::requests::Workspace_Diagnostic_Refresh>([](auto&&...) {}, [](auto&&...) {});
+        } else {
+            stats::flush();
+            input.wait();
+        }
     }
+    stats::finish();
 
     return 0;
 }
@@ -0,0 +1,33 @@
+#include "../stats.h"
+
+#include <cstdlib>
+#include <new>
+
+// counting every allocation costs one thread local add, cheap enough to leave on without --stats. only the server
+// replaces operator new, the core library is linked into the bench and tools with the standard one.
+// kept out of line so gcc doesn't pair the malloc and free of the replacements with the standard ones
+[[gnu::noinline]] void *operator new(std::size_t size) {
+    stats::threadBytes += size;
+    if (void *ptr = std::malloc(size ? size : 1)) return ptr;
+    throw std::bad_alloc();
+}
+
+[[gnu::noinline]] void *operator new[](std::size_t size) {
+    return operator new(size);
+}
+
+[[gnu::noinline]] void operator delete(void *ptr) noexcept {
+    std::free(ptr);
+}
+
+[[gnu::noinline]] void operator delete[](void *ptr) noexcept {
+    std::free(ptr);
+}
+
+[[gnu::noinline]] void operator delete(void *ptr, std::size_t) noexcept {
+    std::free(ptr);
+}
+
+[[gnu::noinline]] void operator delete[](void *ptr, std::size_t) noexcept {
+    std::free(ptr);
+}
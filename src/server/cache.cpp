@@ -0,0 +1,252 @@
+#include "cache.h"
+
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <string>
+#include <unordered_set>
+
+#ifndef _WIN32
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#else
+#include <process.h>
+#endif
+
+// bump when the layout below changes, older files are then ignored
+constexpr char MAGIC[8] = {'U', 'R', 'C', 'L', 'I', 'D', 'X', '2'};
+// bump when the analyser reports different symbols for the same file, cached ones would be stale
+constexpr uint32_t ANALYSIS_VERSION = 1;
+
+// layout, all integers in host byte order:
+//   magic, u32 analysis version, u32 entry count
+//   entry: u32 path length, path, u64 content hash, u32 config flags, u32 symbol count
+//   symbol: u32 name length, name, u8 type, u32 line, u32 start, u32 end
+
+server::cache::cache(const std::filesystem::path& file) : file(file) {
+    load();
+}
+
+server::cache::~cache() {
+#ifndef _WIN32
+    if (data != nullptr && buffer.empty()) munmap(const_cast<char *>(data), size);
+#endif
+}
+
+void server::cache::load() {
+#ifndef _WIN32
+    int fd = open(file.c_str(), O_RDONLY);
+    if (fd >= 0) {
+        struct stat info;
+        if (fstat(fd, &info) == 0 && info.st_size > 0) {
+            void *mapping = mmap(nullptr, info.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+            if (mapping != MAP_FAILED) {
+                data = static_cast<const char *>(mapping);
+                size = info.st_size;
+            }
+        }
+        close(fd);
+    }
+#else
+    std::ifstream in(file, std::ios::binary);
+    buffer.assign(std::istreambuf_iterator<char>(in), std::istreambuf_iterator<char>());
+    data = buffer.data();
+    size = buffer.size();
+#endif
+    if (data == nullptr) return;
+
+    // only the directory of entries is read now, symbols stay in the mapping until used
+    size_t offset = 0;
+    auto read = [this, &offset](void *value, size_t length) {
+        if (size - offset < length) return false;
+        std::memcpy(value, data + offset, length);
+        offset += length;
+        return true;
+    };
+    auto skip = [this, &offset](size_t length) {
+        if (size - offset < length) return false;
+        offset += length;
+        return true;
+    };
+    char magic[sizeof(MAGIC)];
+    uint32_t version;
+    uint32_t entries;
+    if (!read(magic, sizeof(magic)) || std::memcmp(magic, MAGIC, sizeof(MAGIC)) != 0) return;
+    if (!read(&version, sizeof(version)) || version != ANALYSIS_VERSION || !read(&entries, sizeof(entries))) return;
+    for (uint32_t i = 0; i < entries; ++i) {
+        uint32_t length;
+        if (!read(&length, sizeof(length)) || size - offset < length) return;
+        std::filesystem::path path = std::string(data + offset, length);
+        offset += length;
+        mapped_entry entry;
+        if (!read(&entry.hash, sizeof(entry.hash)) || !read(&entry.flags, sizeof(entry.flags)) || !read(&entry.count, sizeof(entry.count))) return;
+        entry.offset = offset;
+        for (uint32_t k = 0; k < entry.count; ++k) {
+            uint32_t nameLength;
+            if (!read(&nameLength, sizeof(nameLength)) || !skip(nameLength + sizeof(uint8_t) + 3 * sizeof(uint32_t))) return;
+        }
+        mapped.emplace(std::move(path), entry);
+    }
+}
+
+std::vector<urcl::symbol> server::cache::decode(const mapped_entry& entry) const {
+    std::vector<urcl::symbol> result;
+    result.reserve(entry.count);
+    size_t offset = entry.offset;
+    auto read = [this, &offset](void *value, size_t length) {
+        std::memcpy(value, data + offset, length);
+        offset += length;
+    };
+    for (uint32_t i = 0; i < entry.count; ++i) {
+        uint32_t length;
+        read(&length, sizeof(length));
+        urcl::symbol symbol;
+        symbol.name.assign(data + offset, length);
+        offset += length;
+        uint8_t type;
+        uint32_t line, start, end;
+        read(&type, sizeof(type));
+        read(&line, sizeof(line));
+        read(&start, sizeof(start));
+        read(&end, sizeof(end));
+        symbol.type = static_cast<urcl::token::types_t>(type);
+        symbol.range = {{line, start}, {line, end}};
+        result.push_back(std::move(symbol));
+    }
+    return result;
+}
+
+std::optional<std::vector<urcl::symbol>> server::cache::find(const std::filesystem::path& file, uint64_t hash, uint32_t flags) {
+    std::lock_guard<std::mutex> lock(mutex);
+    if (stored.contains(file)) {
+        const entry& found = stored.at(file);
+        if (found.hash == hash && found.flags == flags) return found.symbols;
+        return {};
+    }
+    if (!mapped.contains(file)) return {};
+    const mapped_entry& found = mapped.at(file);
+    if (found.hash != hash || found.flags != flags) return {};
+    return decode(found);
+}
+
+void server::cache::store(const std::filesystem::path& file, uint64_t hash, uint32_t flags, std::vector<urcl::symbol> symbols) {
+    std::lock_guard<std::mutex> lock(mutex);
+    stored[file] = {hash, flags, std::move(symbols)};
+    modified = true;
+}
+
+void server::cache::save() {
+    std::lock_guard<std::mutex> lock(mutex);
+    // files deleted since they were indexed are dropped, otherwise the cache would only ever grow
+    std::error_code error;
+    std::unordered_set<std::filesystem::path> deleted;
+    for (const std::pair<const std::filesystem::path, mapped_entry>& entry : mapped) {
+        if (!std::filesystem::exists(entry.first, error)) deleted.insert(entry.first);
+    }
+    for (const std::pair<const std::filesystem::path, entry>& entry : stored) {
+        if (!std::filesystem::exists(entry.first, error)) deleted.insert(entry.first);
+    }
+    if (!modified && deleted.empty()) return;
+
+    std::string out(MAGIC, sizeof(MAGIC));
+    auto write = [&out](const void *value, size_t length) {
+        out.append(static_cast<const char *>(value), length);
+    };
+    write(&ANALYSIS_VERSION, sizeof(ANALYSIS_VERSION));
+    auto writeHeader = [&write](const std::filesystem::path& path, uint64_t hash, uint32_t flags, uint32_t count) {
+        std::string name = path.string();
+        uint32_t length = name.length();
+        write(&length, sizeof(length));
+        write(name.data(), length);
+        write(&hash, sizeof(hash));
+        write(&flags, sizeof(flags));
+        write(&count, sizeof(count));
+    };
+    uint32_t entries = 0;
+    for (const std::pair<const std::filesystem::path, entry>& entry : stored) {
+        if (!deleted.contains(entry.first)) ++entries;
+    }
+    for (const std::pair<const std::filesystem::path, mapped_entry>& entry : mapped) {
+        if (!stored.contains(entry.first) && !deleted.contains(entry.first)) ++entries;
+    }
+    write(&entries, sizeof(entries));
+
+    for (const std::pair<const std::filesystem::path, entry>& entry : stored) {
+        if (deleted.contains(entry.first)) continue;
+        writeHeader(entry.first, entry.second.hash, entry.second.flags, entry.second.symbols.size());
+        for (const urcl::symbol& symbol : entry.second.symbols) {
+            uint32_t length = symbol.name.length();
+            uint8_t type = symbol.type;
+            write(&length, sizeof(length));
+            write(symbol.name.data(), length);
+            write(&type, sizeof(type));
+            write(&symbol.range.start.line, sizeof(uint32_t));
+            write(&symbol.range.start.character, sizeof(uint32_t));
+            write(&symbol.range.end.character, sizeof(uint32_t));
+        }
+    }
+    // entries that weren't touched are copied as they are
+    for (const std::pair<const std::filesystem::path, mapped_entry>& entry : mapped) {
+        if (stored.contains(entry.first) || deleted.contains(entry.first)) continue;
+        writeHeader(entry.first, entry.second.hash, entry.second.flags, entry.second.count);
+        size_t end = entry.second.offset;
+        for (uint32_t i = 0; i < entry.second.count; ++i) {
+            uint32_t length;
+            std::memcpy(&length, data + end, sizeof(length));
+            end += sizeof(length) + length + sizeof(uint8_t) + 3 * sizeof(uint32_t);
+        }
+        write(data + entry.second.offset, end - entry.second.offset);
+    }
+
+    // written next to the old file and renamed over it, so the current mapping stays valid; the name
+    // is per process so another server saving the same cache can't interleave its writes with these
+    std::filesystem::create_directories(file.parent_path(), error);
+    std::filesystem::path temporary = file;
+    temporary += ".tmp." + std::to_string(getpid());
+    {
+        std::ofstream stream(temporary, std::ios::binary | std::ios::trunc);
+        stream.write(out.data(), out.size());
+        if (!stream) {
+            stream.close();
+            std::filesystem::remove(temporary, error);
+            return;
+        }
+    }
+    std::filesystem::rename(temporary, file, error);
+    if (error) {
+        std::filesystem::remove(temporary, error);
+        return;
+    }
+    modified = false;
+}
+
+uint64_t server::cache::hash(std::string_view contents) {
+    // FNV-1a
+    uint64_t result = 14695981039346656037ull;
+    for (char c : contents) {
+        result ^= static_cast<unsigned char>(c);
+        result *= 1099511628211ull;
+    }
+    return result;
+}
+
+uint32_t server::cache::flags(const urcl::config& config) {
+    return config.useCore | config.useBasic << 1 | config.useComplex << 2 | config.useIris << 3 | config.useUrcx << 4
+         | config.useStandard << 5 | config.useLowercase << 6 | config.useUir << 7 | config.useRegs << 8;
+}
+
+std::filesystem::path server::cache::location() {
+#ifdef _WIN32
+    const char *base = std::getenv("LOCALAPPDATA");
+    if (base == nullptr) return {};
+    return std::filesystem::path(base) / "urcl-lsp" / "index.bin";
+#else
+    const char *base = std::getenv("XDG_CACHE_HOME");
+    if (base != nullptr && *base != '\0') return std::filesystem::path(base) / "urcl-lsp" / "index.bin";
+    base = std::getenv("HOME");
+    if (base == nullptr) return {};
+    return std::filesystem::path(base) / ".cache" / "urcl-lsp" / "index.bin";
+#endif
+}
@@ -0,0 +1,59 @@
+#ifndef CACHE_H
+#define CACHE_H
+
+#include "../urcl/config.h"
+#include "../urcl/source.h"
+
+#include <cstdint>
+#include <filesystem>
+#include <mutex>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+
+namespace server {
+    // Symbols of indexed files kept on disk between runs. The file is mapped
+    // on load and entries are only decoded when the file they describe still
+    // has the same contents and config.
+    class cache {
+        public:
+            cache(const std::filesystem::path& file);
+            ~cache();
+
+            std::optional<std::vector<urcl::symbol>> find(const std::filesystem::path& file, uint64_t hash, uint32_t flags);
+            void store(const std::filesystem::path& file, uint64_t hash, uint32_t flags, std::vector<urcl::symbol> symbols);
+            void save();
+
+            static uint64_t hash(std::string_view contents);
+            static uint32_t flags(const urcl::config& config);
+            static std::filesystem::path location();
+        private:
+            struct entry {
+                uint64_t hash;
+                uint32_t flags;
+                std::vector<urcl::symbol> symbols;
+            };
+            struct mapped_entry {
+                uint64_t hash;
+                uint32_t flags;
+                size_t offset; // first symbol
+                uint32_t count;
+            };
+
+            void load();
+            std::vector<urcl::symbol> decode(const mapped_entry& entry) const;
+
+            std::filesystem::path file;
+            std::mutex mutex;
+            const char *data = nullptr;
+            size_t size = 0;
+            std::string buffer; // contents when mapping isn't available
+            std::unordered_map<std::filesystem::path, mapped_entry> mapped;
+            std::unordered_map<std::filesystem::path, entry> stored;
+            bool modified = false;
+    };
+}
+
+#endif
@@ -0,0 +1,94 @@
+#include "check.h"
+#include "../urcl/source.h"
+
+#include <algorithm>
+#include <atomic>
+#include <cstdio>
+#include <fstream>
+#include <string>
+#include <thread>
+
+namespace {
+    enum check_result {
+        clean,
+        failed,
+        unreadable
+    };
+
+    check_result checkFile(const std::filesystem::path& file, std::string& output) {
+        std::ifstream in(file, std::ios::binary);
+        if (!in.is_open()) {
+            output = file.string() + ": error: could not read file\n";
+            return unreadable;
+        }
+        std::vector<std::string> document;
+        std::string line;
+        while (std::getline(in, line)) {
+            if (line.ends_with("\r")) line.pop_back();
+            document.emplace_back(std::move(line));
+        }
+
+        // same passes as an opened document, with includes read from disk
+        urcl::config config(file);
+        urcl::source source(document, config);
+        source.updateReferences({}, config);
+        source.updateDefinitions(file, config);
+        source.updateErrors(config);
+
+        check_result result = clean;
+        for (const lsp::Diagnostic& diagnostic : source.getDiagnostics()) {
+            bool error = diagnostic.severity == lsp::DiagnosticSeverity::Error;
+            if (error) result = failed;
+            output += file.string() + ":" + std::to_string(diagnostic.range.start.line + 1) + ":" + std::to_string(diagnostic.range.start.character + 1)
+                + (error ? ": error: " : ": warning: ") + diagnostic.message + "\n";
+        }
+        return result;
+    }
+}
+
+int server::check(const std::vector<std::filesystem::path>& targets) {
+    std::vector<std::filesystem::path> files;
+    for (const std::filesystem::path& target : targets) {
+        std::error_code error;
+        if (!std::filesystem::is_directory(target, error)) {
+            files.push_back(target);
+            continue;
+        }
+        std::vector<std::filesystem::path> found;
+        std::filesystem::recursive_directory_iterator it(target, std::filesystem::directory_options::skip_permission_denied, error);
+        for (; !error && it != std::filesystem::recursive_directory_iterator(); it.increment(error)) {
+            if (!it->is_regular_file(error)) continue;
+            std::filesystem::path extension = it->path().extension();
+            if (extension == ".urcl" || extension == ".uir") found.push_back(it->path());
+        }
+        // directory order isn't stable, sorting keeps the output comparable between runs
+        std::sort(found.begin(), found.end());
+        files.insert(files.end(), found.begin(), found.end());
+    }
+
+    std::vector<std::string> outputs(files.size());
+    std::vector<check_result> results(files.size(), clean);
+    std::atomic<size_t> next = 0;
+    auto work = [&files, &outputs, &results, &next]() {
+        for (size_t i = next++; i < files.size(); i = next++) {
+            results[i] = checkFile(files[i], outputs[i]);
+        }
+    };
+    unsigned int threads = std::min<size_t>(std::max(1u, std::thread::hardware_concurrency()), files.size());
+    std::vector<std::thread> workers;
+    for (unsigned int i = 1; i < threads; ++i) {
+        workers.emplace_back(work);
+    }
+    work();
+    for (std::thread& worker : workers) {
+        worker.join();
+    }
+
+    // printed in the order the files were given, whichever thread finished first
+    check_result worst = clean;
+    for (size_t i = 0; i < files.size(); ++i) {
+        fputs(outputs[i].c_str(), stdout);
+        worst = std::max(worst, results[i]);
+    }
+    return worst;
+}
@@ -0,0 +1,13 @@
+#ifndef CHECK_H
+#define CHECK_H
+
+#include <filesystem>
+#include <vector>
+
+namespace server {
+    // Runs the editor's analysis over files and directories without a connection, printing
+    // gcc style diagnostics. Returns 1 when any file has an error, 2 when a file can't be read.
+    int check(const std::vector<std::filesystem::path>& targets);
+}
+
+#endif
@@ -0,0 +1,35 @@
+#include "dependencies.h"
+
+void server::dependencies::update(const std::filesystem::path& document, const std::vector<std::filesystem::path>& includes) {
+    remove(document);
+    std::vector<std::filesystem::path>& files = includesOf[document];
+    for (const std::filesystem::path& include : includes) {
+        std::filesystem::path file = normalise(include);
+        includedBy[file].insert(document);
+        files.push_back(std::move(file));
+    }
+}
+
+void server::dependencies::remove(const std::filesystem::path& document) {
+    if (!includesOf.contains(document)) return;
+    for (const std::filesystem::path& file : includesOf.at(document)) {
+        std::unordered_set<std::filesystem::path>& documents = includedBy.at(file);
+        documents.erase(document);
+        if (documents.empty()) includedBy.erase(file);
+    }
+    includesOf.erase(document);
+}
+
+std::vector<std::filesystem::path> server::dependencies::dependents(const std::filesystem::path& file) const {
+    std::filesystem::path normalised = normalise(file);
+    if (!includedBy.contains(normalised)) return {};
+    const std::unordered_set<std::filesystem::path>& documents = includedBy.at(normalised);
+    return std::vector<std::filesystem::path>(documents.begin(), documents.end());
+}
+
+std::filesystem::path server::dependencies::normalise(const std::filesystem::path& file) {
+    // includes are written relative to lsp.txt while events carry absolute paths
+    std::error_code error;
+    std::filesystem::path result = std::filesystem::weakly_canonical(file, error);
+    return error ? file.lexically_normal() : result;
+}
@@ -0,0 +1,25 @@
+#ifndef DEPENDENCIES_H
+#define DEPENDENCIES_H
+
+#include <filesystem>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+
+namespace server {
+    // Which open documents include which files, so a change to a shared include
+    // only reanalyses the documents that actually use it.
+    class dependencies {
+        public:
+            void update(const std::filesystem::path& document, const std::vector<std::filesystem::path>& includes);
+            void remove(const std::filesystem::path& document);
+            std::vector<std::filesystem::path> dependents(const std::filesystem::path& file) const;
+        private:
+            static std::filesystem::path normalise(const std::filesystem::path& file);
+
+            std::unordered_map<std::filesystem::path, std::unordered_set<std::filesystem::path>> includedBy;
+            std::unordered_map<std::filesystem::path, std::vector<std::filesystem::path>> includesOf;
+    };
+}
+
+#endif
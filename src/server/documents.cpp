@@ -0,0 +1,56 @@
+#include "documents.h"
+
+server::handle server::documents::open(const std::filesystem::path& file) {
+    auto found = handles.find(file);
+    if (found != handles.end()) return found->second;
+    server::handle handle;
+    if (freed.empty()) {
+        handle = slots.size();
+        slots.emplace_back();
+    } else {
+        handle = freed.back();
+        freed.pop_back();
+    }
+    server::document& document = slots[handle];
+    document.file = file;
+    document.snapshot = std::make_shared<server::published>();
+    document.open = true;
+    handles.emplace(file, handle);
+    return handle;
+}
+
+void server::documents::close(server::handle handle) {
+    handles.erase(slots[handle].file);
+    // readers holding the old snapshot keep it alive, the slot itself starts over
+    slots[handle] = server::document{};
+    freed.push_back(handle);
+}
+
+server::handle server::documents::find(const std::filesystem::path& file) const {
+    auto found = handles.find(file);
+    return found == handles.end() ? server::NO_DOCUMENT : found->second;
+}
+
+server::handle server::documents::find(const std::function<bool(const server::document&)>& predicate) const {
+    for (server::handle handle = 0; handle < slots.size(); ++handle) {
+        if (slots[handle].open && predicate(slots[handle])) return handle;
+    }
+    return server::NO_DOCUMENT;
+}
+
+std::vector<server::handle> server::documents::all() const {
+    std::vector<server::handle> result;
+    result.reserve(handles.size());
+    for (server::handle handle = 0; handle < slots.size(); ++handle) {
+        if (slots[handle].open) result.push_back(handle);
+    }
+    return result;
+}
+
+server::document& server::documents::operator[](server::handle handle) {
+    return slots[handle];
+}
+
+const server::document& server::documents::operator[](server::handle handle) const {
+    return slots[handle];
+}
@@ -0,0 +1,57 @@
+#ifndef DOCUMENTS_H
+#define DOCUMENTS_H
+
+#include "../urcl/source.h"
+#include "../urcl/config.h"
+#include "snapshot.h"
+
+#include <cstdint>
+#include <filesystem>
+#include <functional>
+#include <memory>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+namespace server {
+    using handle = uint32_t;
+
+    // returned for a URI that isn't open
+    constexpr server::handle NO_DOCUMENT = UINT32_MAX;
+
+    // everything kept for one open document
+    struct document {
+        std::filesystem::path file;
+        int64_t version = -1;
+        std::vector<std::string> text; // the editor's copy, incremental changes are applied to it
+        urcl::config config;
+        urcl::source code; // working copy, lent to the analyser while it is analysed
+        std::shared_ptr<server::published> snapshot;
+        bool unanalysed = false; // rebuilt, includes have to be loaded again
+        bool stale = false; // edited since the last analysis
+        bool reloading = false; // rebuilt for a changed lsp.txt, counted by its progress until analysed
+        uint64_t pushed = 0; // serial of the snapshot whose diagnostics the client last got, published or pulled
+        bool open = false;
+    };
+
+    // Open documents, numbered when they are opened. A request looks its URI up
+    // once and everything after that is indexed by the handle.
+    class documents {
+        public:
+            server::handle open(const std::filesystem::path& file);
+            void close(server::handle handle);
+            server::handle find(const std::filesystem::path& file) const;
+            server::handle find(const std::function<bool(const server::document&)>& predicate) const;
+            std::vector<server::handle> all() const;
+
+            server::document& operator[](server::handle handle);
+            const server::document& operator[](server::handle handle) const;
+        private:
+            std::vector<server::document> slots;
+            // handles of closed documents, reused before the slots grow
+            std::vector<server::handle> freed;
+            std::unordered_map<std::filesystem::path, server::handle> handles;
+    };
+}
+
+#endif
@@ -0,0 +1,237 @@
+#include "index.h"
+
+#include <algorithm>
+#include <cctype>
+#include <fstream>
+#include <sstream>
+
+server::index::~index() {
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        stopping = true;
+    }
+    ready.notify_all();
+    for (std::thread& worker : workers) {
+        worker.join();
+    }
+    if (cache) cache->save();
+}
+
+void server::index::start(const std::vector<std::filesystem::path>& folders, unsigned int threads, const std::filesystem::path& cacheFile, server::progress& progress) {
+    if (!cacheFile.empty()) cache = std::make_unique<server::cache>(cacheFile);
+    this->progress = &progress;
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        this->folders.insert(this->folders.end(), folders.begin(), folders.end());
+        indexing = threads > 0;
+    }
+    for (unsigned int i = 0; i < threads; ++i) {
+        workers.emplace_back(&server::index::run, this);
+    }
+}
+
+void server::index::throttle(bool busy) {
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        this->busy = busy;
+    }
+    if (!busy) ready.notify_all();
+}
+
+void server::index::run() {
+    while (true) {
+        std::filesystem::path next;
+        bool isFolder;
+        {
+            // never take work while a message is being handled
+            std::unique_lock<std::mutex> lock(mutex);
+            ready.wait(lock, [this] { return stopping || (!busy && (!folders.empty() || !queue.empty())); });
+            if (stopping) return;
+            isFolder = queue.empty();
+            std::deque<std::filesystem::path>& work = isFolder ? folders : queue;
+            next = std::move(work.front());
+            work.pop_front();
+            ++parsing;
+        }
+        if (isFolder) {
+            crawl(next);
+        } else {
+            parse(next);
+        }
+        bool drained;
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            drained = --parsing == 0 && folders.empty() && queue.empty();
+        }
+        // write the cache once the workspace has been indexed rather than waiting for exit
+        if (drained && cache) cache->save();
+    }
+}
+
+void server::index::crawl(const std::filesystem::path& folder) {
+    std::error_code error;
+    std::filesystem::recursive_directory_iterator it(folder, std::filesystem::directory_options::skip_permission_denied, error);
+    std::vector<std::filesystem::path> found;
+    for (; !error && !stopping && it != std::filesystem::recursive_directory_iterator(); it.increment(error)) {
+        if (!it->is_regular_file(error)) continue;
+        std::filesystem::path extension = it->path().extension();
+        if (extension == ".urcl" || extension == ".uir") found.push_back(it->path());
+    }
+    // expected before any of them can be parsed and reported done
+    progress->expect(found.size());
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        queue.insert(queue.end(), std::make_move_iterator(found.begin()), std::make_move_iterator(found.end()));
+    }
+    ready.notify_all();
+}
+
+void server::index::parse(const std::filesystem::path& file) {
+    std::ifstream in(file, std::ios::binary);
+    std::string contents((std::istreambuf_iterator<char>(in)), std::istreambuf_iterator<char>());
+    urcl::config config(file);
+
+    // files that haven't changed since the last run are taken from the cache
+    uint64_t hash = 0;
+    uint32_t flags = 0;
+    if (cache) {
+        hash = server::cache::hash(contents);
+        flags = server::cache::flags(config);
+        std::optional<std::vector<urcl::symbol>> cached = cache->find(file, hash, flags);
+        if (cached.has_value()) {
+            update(file, std::move(*cached));
+            progress->done(contents.size());
+            return;
+        }
+    }
+
+    std::vector<std::string> document;
+    std::stringstream stream(contents);
+    std::string line;
+    while (std::getline(stream, line)) {
+        if (line.ends_with("\r")) line.pop_back();
+        document.emplace_back(std::move(line));
+    }
+
+    // includes are indexed as files of their own, so they are not loaded here
+    urcl::source source(document, config);
+    source.updateDefinitions(file, config);
+    std::vector<urcl::symbol> symbols = source.getSymbols();
+    if (cache) cache->store(file, hash, flags, symbols);
+    update(file, std::move(symbols));
+    progress->done(contents.size());
+}
+
+void server::index::enqueue(const std::filesystem::path& file) {
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        if (!indexing) return;
+    }
+    // expected before a worker can parse it and report it done, indexing never stops once started
+    progress->expect(1);
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        queue.push_back(file);
+    }
+    ready.notify_one();
+}
+
+void server::index::update(const std::filesystem::path& file, std::vector<urcl::symbol> symbols) {
+    std::lock_guard<std::mutex> lock(mutex);
+    // saved documents are only kept while indexing, otherwise nothing would ever remove them
+    if (!indexing) return;
+    unlink(file);
+    for (const urcl::symbol& symbol : symbols) {
+        names[symbol.name].emplace_back(file, symbol);
+    }
+    files[file] = std::move(symbols);
+}
+
+void server::index::remove(const std::filesystem::path& file) {
+    std::lock_guard<std::mutex> lock(mutex);
+    unlink(file);
+    files.erase(file);
+}
+
+// drops the definitions a file contributed to names, the mutex has to be held
+void server::index::unlink(const std::filesystem::path& file) {
+    auto found = files.find(file);
+    if (found == files.end()) return;
+    for (const urcl::symbol& symbol : found->second) {
+        auto definitions = names.find(symbol.name);
+        if (definitions == names.end()) continue;
+        std::erase_if(definitions->second, [&file](const std::pair<std::filesystem::path, urcl::symbol>& definition) {
+            return definition.first == file;
+        });
+        if (definitions->second.empty()) names.erase(definitions);
+    }
+}
+
+std::vector<std::pair<std::filesystem::path, urcl::symbol>> server::index::find(const std::string& name) const {
+    std::lock_guard<std::mutex> lock(mutex);
+    auto found = names.find(name);
+    if (found == names.end()) return {};
+    return found->second;
+}
+
+std::vector<server::match> server::index::search(const std::string& query, size_t limit, const std::function<bool(const std::filesystem::path&)>& skip) const {
+    std::vector<server::match> result;
+    std::lock_guard<std::mutex> lock(mutex);
+    for (const std::pair<const std::filesystem::path, std::vector<urcl::symbol>>& file : files) {
+        if (skip(file.first)) continue;
+        for (const urcl::symbol& symbol : file.second) {
+            int score = rank(symbol.name, query);
+            if (score < 0) continue;
+            result.push_back({file.first, symbol, score});
+            // keep memory bounded on large workspaces, pruning only once enough has piled up
+            if (result.size() >= 4 * limit) best(result, limit);
+        }
+    }
+    best(result, limit);
+    return result;
+}
+
+int server::index::rank(std::string_view name, std::string_view query) {
+    if (query.empty()) return 5;
+    auto lower = [](char c) {
+        return static_cast<char>(std::tolower(static_cast<unsigned char>(c)));
+    };
+    auto startsWith = [&lower](std::string_view text, std::string_view prefix) {
+        if (prefix.length() > text.length()) return false;
+        return std::equal(prefix.begin(), prefix.end(), text.begin(), [&lower](char a, char b) {
+            return lower(a) == lower(b);
+        });
+    };
+    // labels, symbols and constants carry a sigil the user usually leaves out
+    std::string_view bare = name;
+    if (!query.starts_with(name.substr(0, 1))) {
+        while (!bare.empty() && (bare[0] == '.' || bare[0] == '!' || bare[0] == '@')) bare.remove_prefix(1);
+    }
+    if (bare == query) return 0;
+    if (bare.starts_with(query)) return 1;
+    if (startsWith(bare, query)) return 2;
+    for (size_t i = 1; i < bare.length(); ++i) {
+        if (startsWith(bare.substr(i), query)) return 3;
+    }
+    // every character of the query in order, e.g. "lp" for "LOOP"
+    size_t found = 0;
+    for (char c : bare) {
+        if (found < query.length() && lower(c) == lower(query[found])) ++found;
+    }
+    return found == query.length() ? 4 : -1;
+}
+
+void server::index::best(std::vector<server::match>& matches, size_t limit) {
+    auto better = [](const server::match& a, const server::match& b) {
+        if (a.rank != b.rank) return a.rank < b.rank;
+        if (a.symbol.name.length() != b.symbol.name.length()) return a.symbol.name.length() < b.symbol.name.length();
+        if (a.symbol.name != b.symbol.name) return a.symbol.name < b.symbol.name;
+        if (a.file != b.file) return a.file < b.file;
+        return a.symbol.range.start.line < b.symbol.range.start.line;
+    };
+    if (matches.size() > limit) {
+        std::nth_element(matches.begin(), matches.begin() + limit, matches.end(), better);
+        matches.resize(limit);
+    }
+    std::sort(matches.begin(), matches.end(), better);
+}
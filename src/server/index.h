@@ -0,0 +1,72 @@
+#ifndef INDEX_H
+#define INDEX_H
+
+#include "../urcl/source.h"
+#include "cache.h"
+#include "progress.h"
+
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <filesystem>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+namespace server {
+    // most results workspace/symbol returns for a query
+    constexpr size_t MAX_WORKSPACE_SYMBOLS = 256;
+
+    struct match {
+        std::filesystem::path file;
+        urcl::symbol symbol;
+        int rank; // lower is better
+    };
+
+    // Definitions of every URCL file in the workspace, collected by background
+    // workers that stand aside whenever the server is busy with a message.
+    class index {
+        public:
+            ~index();
+
+            void start(const std::vector<std::filesystem::path>& folders, unsigned int threads, const std::filesystem::path& cacheFile, server::progress& progress);
+            void throttle(bool busy);
+
+            void enqueue(const std::filesystem::path& file);
+            void update(const std::filesystem::path& file, std::vector<urcl::symbol> symbols);
+            void remove(const std::filesystem::path& file);
+            std::vector<std::pair<std::filesystem::path, urcl::symbol>> find(const std::string& name) const;
+            std::vector<server::match> search(const std::string& query, size_t limit, const std::function<bool(const std::filesystem::path&)>& skip) const;
+
+            static int rank(std::string_view name, std::string_view query);
+            static void best(std::vector<server::match>& matches, size_t limit);
+        private:
+            void run();
+            void crawl(const std::filesystem::path& folder);
+            void parse(const std::filesystem::path& file);
+            void unlink(const std::filesystem::path& file);
+
+            mutable std::mutex mutex;
+            std::condition_variable ready;
+            std::deque<std::filesystem::path> folders;
+            std::deque<std::filesystem::path> queue;
+            bool busy = false;
+            std::atomic<bool> stopping = false;
+            std::vector<std::thread> workers;
+            // set before the workers start, read instead of workers while they run
+            bool indexing = false;
+            std::unordered_map<std::filesystem::path, std::vector<urcl::symbol>> files;
+            // every definition of a name, so definition lookups don't scan the whole workspace
+            std::unordered_map<std::string, std::vector<std::pair<std::filesystem::path, urcl::symbol>>> names;
+            std::unique_ptr<server::cache> cache;
+            server::progress *progress = nullptr;
+            unsigned int parsing = 0;
+    };
+}
+
+#endif
@@ -0,0 +1,181 @@
+#include "input.h"
+#include "../util.h"
+
+#include <algorithm>
+#include <cstring>
+#include <functional>
+#include <optional>
+#include <stdexcept>
+#include <string_view>
+#include <unordered_map>
+
+namespace {
+    const std::unordered_map<std::string_view, server::priority> PRIORITIES = {
+        {"textDocument/completion", server::interactive},
+        {"textDocument/hover", server::interactive},
+        {"textDocument/definition", server::interactive},
+        {"textDocument/semanticTokens/full", server::display},
+        {"textDocument/semanticTokens/range", server::display},
+        {"textDocument/diagnostic", server::display},
+        {"workspace/diagnostic", server::display},
+        {"textDocument/references", server::deferred},
+        {"textDocument/documentSymbol", server::deferred},
+        {"textDocument/foldingRange", server::deferred},
+        {"workspace/symbol", server::deferred},
+        {"workspace/executeCommand", server::deferred}
+    };
+}
+
+server::input::input(lsp::io::Stream& stream) : stream(stream), state(std::make_shared<server::input_state>()) {
+    reader = std::thread(&server::input::run, std::ref(stream), state);
+}
+
+server::input::~input() {
+    // the reader is most likely blocked on a read that will never return, it only touches the shared state
+    reader.detach();
+}
+
+void server::input::run(lsp::io::Stream& stream, std::shared_ptr<server::input_state> state) {
+    try {
+        while (true) {
+            std::string message;
+            size_t length = 0;
+            // header lines end with \r\n, an empty line ends the header
+            while (!message.ends_with("\r\n\r\n")) {
+                char c;
+                stream.read(&c, 1);
+                message += c;
+                if (message.ends_with("\r\n")) {
+                    size_t start = message.rfind("\r\n", message.length() - 3);
+                    start = start == std::string::npos ? 0 : start + 2;
+                    std::string_view line = std::string_view(message).substr(start);
+                    if (line.starts_with("Content-Length:")) {
+                        length = std::stoul(std::string(line.substr(15)));
+                    }
+                }
+            }
+            size_t headerLength = message.length();
+            message.resize(headerLength + length);
+            stream.read(message.data() + headerLength, length);
+
+            std::lock_guard<std::mutex> lock(state->mutex);
+            if (state->recording.is_open()) {
+                // "<milliseconds> <length>\n<body>\n"
+                std::chrono::duration<double, std::milli> elapsed = std::chrono::steady_clock::now() - state->recordStart;
+                state->recording << elapsed.count() << ' ' << length << '\n';
+                state->recording.write(message.data() + headerLength, length);
+                state->recording << '\n';
+                state->recording.flush();
+            }
+            server::priority priority = classify(std::string_view(message).substr(headerLength));
+            enqueue(*state, std::move(message), priority);
+            state->available.notify_all();
+        }
+    } catch (std::exception&) {
+        std::lock_guard<std::mutex> lock(state->mutex);
+        state->eof = true;
+        state->available.notify_all();
+    }
+}
+
+server::priority server::input::classify(std::string_view body) {
+    // responses and notifications have no id, or no method
+    std::optional<std::string_view> method = util::jsonMember(body, "method");
+    if (!method.has_value() || !util::jsonMember(body, "id").has_value()) return server::ordered;
+    std::string_view name = *method;
+    if (name.length() >= 2 && name.front() == '"') name = name.substr(1, name.length() - 2);
+    auto found = PRIORITIES.find(name);
+    return found == PRIORITIES.end() ? server::ordered : found->second;
+}
+
+void server::input::enqueue(server::input_state& state, std::string&& text, server::priority priority) {
+    // a request moves ahead of waiting requests it outranks, the message being read stays first
+    auto position = state.messages.end();
+    auto first = state.messages.begin() + (state.offset > 0 ? 1 : 0);
+    while (priority != server::ordered && position != first) {
+        auto previous = std::prev(position);
+        if (previous->priority == server::ordered || previous->priority <= priority) break;
+        position = previous;
+    }
+    state.messages.insert(position, server::message{std::move(text), priority});
+}
+
+void server::input::read(char *buffer, std::size_t size) {
+    std::unique_lock<std::mutex> lock(state->mutex);
+    while (size > 0) {
+        state->available.wait(lock, [this]() { return !state->messages.empty() || state->eof; });
+        if (state->messages.empty()) throw std::runtime_error("input closed");
+        const std::string& front = state->messages.front().text;
+        size_t count = std::min(size, front.length() - state->offset);
+        memcpy(buffer, front.data() + state->offset, count);
+        buffer += count;
+        size -= count;
+        state->offset += count;
+        if (state->offset == front.length()) {
+            size_t body = front.find("\r\n\r\n") + 4;
+            state->current = util::jsonMember(std::string_view(front).substr(body), "id").value_or("");
+            state->messages.pop_front();
+            state->offset = 0;
+        }
+    }
+}
+
+void server::input::write(const char *buffer, std::size_t size) {
+    stream.write(buffer, size);
+}
+
+bool server::input::pending() {
+    std::lock_guard<std::mutex> lock(state->mutex);
+    return !state->messages.empty();
+}
+
+std::string server::input::request() {
+    std::lock_guard<std::mutex> lock(state->mutex);
+    return state->current;
+}
+
+bool server::input::cancelled(std::string_view id) {
+    // the cancellation is still queued behind the request it cancels, it is handled normally once its turn comes
+    std::lock_guard<std::mutex> lock(state->mutex);
+    if (id.empty()) return false;
+    for (const server::message& message : state->messages) {
+        std::string_view body = std::string_view(message.text).substr(message.text.find("\r\n\r\n") + 4);
+        if (util::jsonMember(body, "method") != "\"$/cancelRequest\"") continue;
+        std::optional<std::string_view> params = util::jsonMember(body, "params");
+        if (params.has_value() && util::jsonMember(*params, "id") == id) return true;
+    }
+    return false;
+}
+
+bool server::input::closed() {
+    std::lock_guard<std::mutex> lock(state->mutex);
+    return state->eof && state->messages.empty();
+}
+
+bool server::input::record(const std::filesystem::path& file) {
+    std::lock_guard<std::mutex> lock(state->mutex);
+    state->recording.open(file, std::ios::binary | std::ios::trunc);
+    state->recordStart = std::chrono::steady_clock::now();
+    // messages that arrived before the command line was read
+    for (const server::message& message : state->messages) {
+        size_t body = message.text.find("\r\n\r\n") + 4;
+        state->recording << 0 << ' ' << message.text.length() - body << '\n';
+        state->recording.write(message.text.data() + body, message.text.length() - body);
+        state->recording << '\n';
+    }
+    return state->recording.is_open();
+}
+
+void server::input::wait() {
+    std::unique_lock<std::mutex> lock(state->mutex);
+    state->available.wait(lock, [this]() { return !state->messages.empty() || state->eof || state->woken; });
+    state->woken = false;
+}
+
+void server::input::wake() {
+    {
+        std::lock_guard<std::mutex> lock(state->mutex);
+        state->woken = true;
+    }
+    state->available.notify_all();
+}
@@ -0,0 +1,77 @@
+#ifndef INPUT_H
+#define INPUT_H
+
+#include <lsp/io/stream.h>
+
+#include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <filesystem>
+#include <fstream>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <thread>
+
+namespace server {
+    // order in which queued requests are answered, lower runs first
+    enum priority {
+        interactive, // completion, hover and definition
+        display, // semantic tokens and diagnostics
+        deferred, // other requests
+        ordered // notifications and responses, nothing is moved past them
+    };
+
+    struct message {
+        std::string text;
+        server::priority priority;
+    };
+
+    // everything the reader thread touches, it keeps its own reference so a
+    // read that returns after the input is gone has somewhere to go
+    struct input_state {
+        std::mutex mutex;
+        std::condition_variable available;
+        std::deque<server::message> messages;
+        size_t offset = 0;
+        // id of the last message read, which is the one being handled
+        std::string current;
+        bool eof = false;
+        bool woken = false; // wait() returns even though no message arrived
+        // every message received, with the time since recording started, for urcl-lsp-replay
+        std::ofstream recording;
+        std::chrono::steady_clock::time_point recordStart;
+    };
+
+    // Reads whole messages from the wrapped stream on a separate thread so the
+    // main loop can tell whether a message is waiting before starting idle work.
+    // Requests are queued ahead of waiting requests of a lower priority.
+    class input : public lsp::io::Stream {
+        public:
+            input(lsp::io::Stream& stream);
+            ~input();
+
+            void read(char *buffer, std::size_t size) override;
+            void write(const char *buffer, std::size_t size) override;
+
+            bool pending();
+            bool closed();
+            void wait();
+            void wake();
+            std::string request();
+            bool cancelled(std::string_view id);
+            bool record(const std::filesystem::path& file);
+
+            static server::priority classify(std::string_view body);
+        private:
+            static void run(lsp::io::Stream& stream, std::shared_ptr<server::input_state> state);
+            static void enqueue(server::input_state& state, std::string&& text, server::priority priority);
+
+            lsp::io::Stream& stream;
+            std::shared_ptr<server::input_state> state;
+            std::thread reader;
+    };
+}
+
+#endif
@@ -0,0 +1,71 @@
+#include "progress.h"
+
+#include <format>
+
+server::progress::progress(std::string name, std::string title, std::function<void()> changed) : name(std::move(name)), title(std::move(title)), changed(std::move(changed)) {}
+
+void server::progress::enable() {
+    std::lock_guard<std::mutex> lock(mutex);
+    enabled = true;
+}
+
+void server::progress::expect(size_t files) {
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        if (!enabled || files == 0) return;
+        total += files;
+        updated = true;
+    }
+    changed();
+}
+
+void server::progress::done(size_t bytes) {
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        if (!enabled) return;
+        ++files;
+        this->bytes += bytes;
+        updated = true;
+    }
+    changed();
+}
+
+std::optional<server::progress_report> server::progress::poll() {
+    std::lock_guard<std::mutex> lock(mutex);
+    if (!updated) return {};
+    std::chrono::steady_clock::time_point now = std::chrono::steady_clock::now();
+    std::string token = std::format("urcl-lsp/{}/{}", name, generation);
+    if (files >= total) {
+        // finished before it was worth reporting, or the end of a reported task
+        std::optional<server::progress_report> result;
+        if (begun) result = server::progress_report{token, false, lsp::json::Object{{"kind", "end"}, {"message", message()}}};
+        total = files = bytes = 0;
+        begun = updated = false;
+        return result;
+    }
+    if (!begun) {
+        begun = true;
+        updated = false;
+        reported = now;
+        token = std::format("urcl-lsp/{}/{}", name, ++generation);
+        return server::progress_report{token, true, lsp::json::Object{
+            {"kind", "begin"},
+            {"title", title},
+            {"cancellable", false},
+            {"message", message()},
+            {"percentage", static_cast<lsp::json::Integer>(files * 100 / total)}
+        }};
+    }
+    if (now - reported < server::PROGRESS_INTERVAL) return {};
+    updated = false;
+    reported = now;
+    return server::progress_report{token, false, lsp::json::Object{
+        {"kind", "report"},
+        {"message", message()},
+        {"percentage", static_cast<lsp::json::Integer>(files * 100 / total)}
+    }};
+}
+
+std::string server::progress::message() const {
+    return std::format("{}/{} files, {} KiB", files, total, bytes / 1024);
+}
@@ -0,0 +1,52 @@
+#ifndef PROGRESS_H
+#define PROGRESS_H
+
+#include <lsp/json/json.h>
+
+#include <chrono>
+#include <cstddef>
+#include <functional>
+#include <mutex>
+#include <optional>
+#include <string>
+
+namespace server {
+    // shortest time between two reports of the same task
+    constexpr std::chrono::milliseconds PROGRESS_INTERVAL{100};
+
+    struct progress_report {
+        std::string token;
+        bool create; // the token has to be created with window/workDoneProgress/create first
+        lsp::json::Object value;
+    };
+
+    // Files and bytes a task has processed on any thread. Only the main loop
+    // talks to the client, so it polls for the next $/progress value to send.
+    class progress {
+        public:
+            progress(std::string name, std::string title, std::function<void()> changed);
+
+            void enable();
+            void expect(size_t files);
+            void done(size_t bytes);
+            std::optional<server::progress_report> poll();
+        private:
+            std::string message() const;
+
+            std::mutex mutex;
+            std::string name;
+            std::string title;
+            // wakes the main loop so it can report
+            std::function<void()> changed;
+            bool enabled = false;
+            size_t total = 0;
+            size_t files = 0;
+            size_t bytes = 0;
+            bool begun = false;
+            bool updated = false;
+            unsigned int generation = 0;
+            std::chrono::steady_clock::time_point reported;
+    };
+}
+
+#endif
@@ -0,0 +1,102 @@
+#include "snapshot.h"
+
+#include "../stats.h"
+
+namespace {
+    std::atomic<uint64_t> serials = 0;
+}
+
+std::string server::snapshot::resultId() const {
+    return std::to_string(version) + "." + std::to_string(serial);
+}
+
+std::shared_ptr<const server::snapshot> server::published::load() const {
+    std::lock_guard<std::mutex> lock(mutex);
+    return current;
+}
+
+void server::published::store(std::shared_ptr<const server::snapshot> next) {
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        current.swap(next);
+    }
+    // the previous snapshot is released outside the lock, it may be the last reference
+}
+
+server::analyser::analyser(server::progress& loading, std::function<void()> finished) : loading(loading), notify(std::move(finished)) {
+    worker = std::thread(&server::analyser::run, this);
+}
+
+server::analyser::~analyser() {
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        stopping = true;
+    }
+    ready.notify_all();
+    worker.join();
+}
+
+void server::analyser::start(server::analysis&& job) {
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        this->job = std::move(job);
+        finished = false;
+    }
+    ready.notify_all();
+}
+
+bool server::analyser::idle() {
+    std::lock_guard<std::mutex> lock(mutex);
+    return !job.has_value();
+}
+
+bool server::analyser::analysing(const std::filesystem::path& file) {
+    std::lock_guard<std::mutex> lock(mutex);
+    return job.has_value() && job->file == file;
+}
+
+std::optional<server::analysis> server::analyser::collect(bool wait) {
+    std::unique_lock<std::mutex> lock(mutex);
+    if (wait) ready.wait(lock, [this] { return !job.has_value() || finished; });
+    if (!job.has_value() || !finished) return {};
+    std::optional<server::analysis> result = std::move(job);
+    job.reset();
+    return result;
+}
+
+void server::analyser::run() {
+    while (true) {
+        server::analysis *current;
+        {
+            std::unique_lock<std::mutex> lock(mutex);
+            ready.wait(lock, [this] { return stopping || (job.has_value() && !finished); });
+            if (stopping) return;
+            // the job stays in place until it is collected, nothing else touches it meanwhile
+            current = &*job;
+        }
+        stats::scope scope("analyse");
+        scope.document(current->file, current->version);
+        if (current->references) {
+            loading.expect(current->config.includes.size());
+            current->code.updateReferences(current->open, current->config, [this](size_t bytes) {
+                loading.done(bytes);
+            });
+        }
+        current->code.updateDefinitions(current->file, current->config);
+        current->code.updateErrors(current->config);
+        server::publish(*current->target, current->version, current->config, current->code);
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            finished = true;
+        }
+        ready.notify_all();
+        notify();
+    }
+}
+
+std::shared_ptr<const server::snapshot> server::publish(server::published& target, int64_t version, const urcl::config& config, const urcl::source& code) {
+    // readers keep whichever snapshot they loaded, the copy shares lines and includes until the working source edits them
+    std::shared_ptr<const server::snapshot> next = std::make_shared<const server::snapshot>(server::snapshot{version, config, code, ++serials});
+    target.store(next);
+    return next;
+}
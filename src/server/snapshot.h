@@ -0,0 +1,84 @@
+#ifndef SNAPSHOT_H
+#define SNAPSHOT_H
+
+#include "../urcl/source.h"
+#include "../urcl/config.h"
+#include "progress.h"
+
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <filesystem>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <utility>
+
+namespace server {
+    // One analysed version of a document. Nothing changes it once it has been
+    // published, so it can be read from any thread without locking.
+    struct snapshot {
+        int64_t version = -1;
+        urcl::config config;
+        urcl::source code;
+        uint64_t serial = 0; // counts every publish, an include change reanalyses without a new version
+
+        std::string resultId() const;
+    };
+
+    // The newest snapshot of a document, swapped whenever an analysis finishes.
+    // The lock only covers the pointer, readers use the snapshot without it.
+    class published {
+        public:
+            std::shared_ptr<const server::snapshot> load() const;
+            void store(std::shared_ptr<const server::snapshot> next);
+        private:
+            mutable std::mutex mutex;
+            std::shared_ptr<const server::snapshot> current;
+    };
+
+    struct analysis {
+        std::filesystem::path file;
+        int64_t version = -1;
+        urcl::config config;
+        urcl::source code;
+        bool references = false; // includes have to be loaded again
+        std::unordered_map<std::filesystem::path, std::shared_ptr<const urcl::source>> open; // open documents the file includes
+        std::shared_ptr<server::published> target;
+    };
+
+    // Analyses one document at a time on a worker thread. The working source is
+    // moved in, the result is published as a snapshot and the source is handed
+    // back by collect() so later edits can be applied to it incrementally.
+    class analyser {
+        public:
+            analyser(server::progress& loading, std::function<void()> finished);
+            ~analyser();
+
+            void start(server::analysis&& job);
+            bool idle();
+            bool analysing(const std::filesystem::path& file);
+            std::optional<server::analysis> collect(bool wait);
+        private:
+            void run();
+
+            std::mutex mutex;
+            std::condition_variable ready;
+            // files read while including
+            server::progress& loading;
+            std::optional<server::analysis> job;
+            bool finished = false;
+            bool stopping = false;
+            // called on the worker once a result is ready, to wake the main loop
+            std::function<void()> notify;
+            std::thread worker;
+    };
+
+    std::shared_ptr<const server::snapshot> publish(server::published& target, int64_t version, const urcl::config& config, const urcl::source& code);
+}
+
+#endif
@@ -0,0 +1,114 @@
+#include "stats.h"
+
+#include <algorithm>
+#include <cstdio>
+#include <fstream>
+#include <iomanip>
+#include <map>
+#include <mutex>
+
+namespace {
+    // the indexing threads parse files too, so every counter is behind the lock
+    std::mutex lock;
+    std::map<std::string_view, stats::counter> all;
+
+    std::mutex traceLock;
+    std::ofstream traceFile;
+    std::chrono::steady_clock::time_point traceStart;
+    bool firstEvent = true;
+    std::atomic<uint32_t> threads = 0;
+    // small ids read better than the native thread handles in trace viewers
+    thread_local uint32_t threadId = ++threads;
+
+    void writeString(std::ostream& out, std::string_view str) {
+        out << '"';
+        for (char c : str) {
+            if (c == '"' || c == '\\') {
+                out << '\\' << c;
+            } else if (static_cast<unsigned char>(c) < 0x20) {
+                char escaped[8];
+                std::snprintf(escaped, sizeof(escaped), "\\u%04x", c);
+                out << escaped;
+            } else {
+                out << c;
+            }
+        }
+        out << '"';
+    }
+}
+
+std::atomic<bool> stats::enabled = false;
+std::atomic<bool> stats::tracing = false;
+thread_local uint64_t stats::threadBytes = 0;
+
+uint64_t stats::allocated() {
+    return threadBytes;
+}
+
+void stats::record(std::string_view name, std::chrono::steady_clock::duration elapsed, uint64_t bytes) {
+    uint64_t ns = std::chrono::duration_cast<std::chrono::nanoseconds>(elapsed).count();
+    std::lock_guard<std::mutex> guard(lock);
+    stats::counter& counter = all[name];
+    ++counter.count;
+    counter.totalNs += ns;
+    counter.maxNs = std::max(counter.maxNs, ns);
+    counter.bytes += bytes;
+}
+
+std::vector<std::pair<std::string, stats::counter>> stats::counters() {
+    std::lock_guard<std::mutex> guard(lock);
+    std::vector<std::pair<std::string, stats::counter>> result;
+    result.reserve(all.size());
+    for (const std::pair<const std::string_view, stats::counter>& counter : all) {
+        result.emplace_back(std::string(counter.first), counter.second);
+    }
+    return result;
+}
+
+void stats::reset() {
+    std::lock_guard<std::mutex> guard(lock);
+    all.clear();
+}
+
+bool stats::trace(const std::filesystem::path& file) {
+    std::lock_guard<std::mutex> guard(traceLock);
+    traceFile.open(file, std::ios::binary | std::ios::trunc);
+    if (!traceFile.is_open()) return false;
+    traceStart = std::chrono::steady_clock::now();
+    traceFile << std::fixed << std::setprecision(3) << "[\n";
+    tracing = true;
+    return true;
+}
+
+void stats::traceEvent(std::string_view name, std::chrono::steady_clock::time_point start, std::chrono::steady_clock::time_point end, const std::string& document, int64_t version) {
+    std::lock_guard<std::mutex> guard(traceLock);
+    if (!traceFile.is_open()) return;
+    if (!firstEvent) traceFile << ",\n";
+    firstEvent = false;
+    // complete events with microsecond timestamps
+    double ts = std::chrono::duration<double, std::micro>(start - traceStart).count();
+    double dur = std::chrono::duration<double, std::micro>(end - start).count();
+    traceFile << "{\"name\":";
+    writeString(traceFile, name);
+    traceFile << ",\"ph\":\"X\",\"pid\":1,\"tid\":" << threadId << ",\"ts\":" << ts << ",\"dur\":" << dur;
+    if (!document.empty()) {
+        traceFile << ",\"args\":{\"document\":";
+        writeString(traceFile, document);
+        if (version >= 0) traceFile << ",\"version\":" << version;
+        traceFile << '}';
+    }
+    traceFile << '}';
+}
+
+void stats::flush() {
+    std::lock_guard<std::mutex> guard(traceLock);
+    if (traceFile.is_open()) traceFile.flush();
+}
+
+void stats::finish() {
+    std::lock_guard<std::mutex> guard(traceLock);
+    if (!traceFile.is_open()) return;
+    tracing = false;
+    traceFile << "\n]\n";
+    traceFile.close();
+}
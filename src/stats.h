@@ -0,0 +1,79 @@
+#ifndef STATS_H
+#define STATS_H
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <filesystem>
+#include <string>
+#include <string_view>
+#include <utility>
+#include <vector>
+
+namespace stats {
+    struct counter {
+        uint64_t count = 0;
+        uint64_t totalNs = 0;
+        uint64_t maxNs = 0;
+        uint64_t bytes = 0; // allocated while the scope was open, including nested scopes
+    };
+
+    // set by --stats, scopes do nothing while it and tracing are off
+    extern std::atomic<bool> enabled;
+    // set by --trace once the trace file is open
+    extern std::atomic<bool> tracing;
+
+    // bytes requested from operator new by the calling thread, only the server replaces it to count them
+    extern thread_local uint64_t threadBytes;
+
+    // bytes requested from operator new by the calling thread so far
+    uint64_t allocated();
+
+    void record(std::string_view name, std::chrono::steady_clock::duration elapsed, uint64_t bytes);
+
+    std::vector<std::pair<std::string, stats::counter>> counters();
+
+    void reset();
+
+    // writes every traced scope to the file in the trace event format read by chrome://tracing and Perfetto
+    bool trace(const std::filesystem::path& file);
+    void traceEvent(std::string_view name, std::chrono::steady_clock::time_point start, std::chrono::steady_clock::time_point end, const std::string& document, int64_t version);
+    void flush();
+    void finish();
+
+    // times an LSP method or a phase of the analysis, the name has to be a string literal
+    class scope {
+        public:
+            // scopes entered once per line pass traced = false, the trace would be mostly those otherwise
+            scope(std::string_view name, bool traced = true) : name(name), counted(enabled.load(std::memory_order_relaxed)), traced(traced && tracing.load(std::memory_order_relaxed)) {
+                if (!counted && !this->traced) return;
+                bytes = allocated();
+                start = std::chrono::steady_clock::now();
+            }
+            ~scope() {
+                if (!counted && !traced) return;
+                std::chrono::steady_clock::time_point end = std::chrono::steady_clock::now();
+                if (counted) record(name, end - start, allocated() - bytes);
+                if (traced) traceEvent(name, start, end, file, version);
+            }
+            scope(const scope&) = delete;
+            scope& operator=(const scope&) = delete;
+
+            // the document the scope works on, shown with the span in traces
+            void document(const std::filesystem::path& path, int64_t version = -1) {
+                if (!traced) return;
+                file = path.string();
+                this->version = version;
+            }
+        private:
+            std::string_view name;
+            bool counted;
+            bool traced;
+            uint64_t bytes = 0;
+            std::chrono::steady_clock::time_point start;
+            std::string file;
+            int64_t version = -1;
+    };
+}
+
+#endif
@@ -1,24 +1,47 @@
 #include "config.h"
 #include "../util.h"
 
+#include <algorithm>
 #include <fstream>
 
 urcl::config::config() {}
 
-urcl::config::config(std::filesystem::path file, const std::filesystem::path& src) {
+// the parts of a lsp.txt that don't depend on which file is being configured
+struct urcl::config::parsed_file {
+    std::filesystem::file_time_type time;
+    urcl::config options;
+    // every line of paths, with the canonical form of the paths that existed when it was read
+    std::vector<std::vector<std::pair<std::filesystem::path, std::filesystem::path>>> includes;
+};
+
+std::mutex urcl::config::cacheLock;
+bool urcl::config::watched = false;
+std::unordered_map<std::filesystem::path, std::filesystem::path> urcl::config::directories;
+std::unordered_map<std::filesystem::path, std::shared_ptr<const urcl::config::parsed_file>> urcl::config::files;
+
+std::shared_ptr<const urcl::config::parsed_file> urcl::config::load(const std::filesystem::path& file) {
+    std::error_code error;
+    std::filesystem::file_time_type time = std::filesystem::last_write_time(file, error);
+    {
+        std::lock_guard<std::mutex> lock(cacheLock);
+        if (files.contains(file) && files.at(file)->time == time) return files.at(file);
+    }
+
+    std::shared_ptr<urcl::config::parsed_file> result = std::make_shared<urcl::config::parsed_file>();
+    result->time = time;
+    urcl::config& options = result->options;
     std::ifstream in(file);
     std::string line;
     
-    useCore = true;
-    useBasic = true;
-    useComplex = true;
-    useStandard = false;
-    useIris = false;
-    useUrcx = false;
-    useLowercase = false;
-    useUir = false;
-    useRegs = true;
-    bool foundIncludes = false;
+    options.useCore = true;
+    options.useBasic = true;
+    options.useComplex = true;
+    options.useStandard = false;
+    options.useIris = false;
+    options.useUrcx = false;
+    options.useLowercase = false;
+    options.useUir = false;
+    options.useRegs = true;
 
     while (std::getline(in, line)) {
         if (line.size() && line[line.size() - 1] == '\r') {
@@ -37,32 +60,31 @@ urcl::config::config(std::filesystem::path file, const std::filesystem::path& sr
             case ('+'): { // add config option
                 std::string_view value = std::string_view(line).substr(1);
                 if (value == "core") {
-                    useCore = set;
+                    options.useCore = set;
                 } else if (value == "basic") {
-                    useBasic = set;
+                    options.useBasic = set;
                 } else if (value == "complex") {
-                    useComplex = set;
+                    options.useComplex = set;
                 } else if (value == "standard") {
-                    useStandard = set;
+                    options.useStandard = set;
                 } else if (value == "iris") {
-                    useIris = set;
+                    options.useIris = set;
                 } else if (value == "urcx") {
-                    useUrcx = set;
+                    options.useUrcx = set;
                 } else if (value == "irix") {
-                    useUrcx = set;
-                    useIris = set;
+                    options.useUrcx = set;
+                    options.useIris = set;
                 } else if (value == "lowercase") {
-                    useLowercase = set;
+                    options.useLowercase = set;
                 } else if (value == "regs") {
-                    useRegs = set;
+                    options.useRegs = set;
                 } else if (value == "uir") {
-                    useUir = set;
+                    options.useUir = set;
                 }
                 break;
             }
             default: // path
-                if (foundIncludes) continue;
-                std::vector<std::filesystem::path> paths;
+                std::vector<std::pair<std::filesystem::path, std::filesystem::path>> paths;
                 while (line != "") {
                     size_t end;
                     for (end = 0; end < line.length(); ++end) {
@@ -82,20 +104,60 @@ urcl::config::config(std::filesystem::path file, const std::filesystem::path& sr
                         line = "";
                     }
 
-                    paths.push_back(file.parent_path()/pathEnd);
-                }
-                for (size_t i = 0; i < paths.size(); ++i) {
-                    std::filesystem::path& path = paths[i];
-                    if (std::filesystem::exists(path) && std::filesystem::equivalent(path, src)) {
-                        paths.erase(paths.begin() + i);
-                        foundIncludes = true;
-                        this->includes = std::move(paths);
-                        break;
-                    }
+                    std::filesystem::path path = file.parent_path()/pathEnd;
+                    std::filesystem::path canonical = std::filesystem::canonical(path, error);
+                    paths.emplace_back(std::move(path), error ? std::filesystem::path() : std::move(canonical));
                 }
+                result->includes.push_back(std::move(paths));
         }
 
     }
+
+    std::lock_guard<std::mutex> lock(cacheLock);
+    files[file] = result;
+    return result;
+}
+
+std::filesystem::path urcl::config::find(const std::filesystem::path& directory, const std::filesystem::path& root) {
+    std::vector<std::filesystem::path> visited;
+    std::filesystem::path path = directory;
+    std::filesystem::path result;
+    {
+        std::lock_guard<std::mutex> lock(cacheLock);
+        while (path != root) {
+            if (watched && directories.contains(path)) {
+                result = directories.at(path);
+                break;
+            }
+            visited.push_back(path);
+            if (std::filesystem::exists(path / "lsp.txt")) {
+                result = path / "lsp.txt";
+                break;
+            }
+            path = path.parent_path();
+        }
+        // without invalidation a cached miss would hide a lsp.txt created later
+        if (watched) {
+            for (const std::filesystem::path& walked : visited) {
+                directories[walked] = result;
+            }
+        }
+    }
+    return result;
+}
+
+void urcl::config::invalidate(const std::filesystem::path& file) {
+    if (file.filename() != "lsp.txt") return;
+    std::lock_guard<std::mutex> lock(cacheLock);
+    // creating or deleting a lsp.txt changes which one applies to every directory below it
+    directories.clear();
+    files.erase(file);
+}
+
+void urcl::config::watch(bool enabled) {
+    std::lock_guard<std::mutex> lock(cacheLock);
+    watched = enabled;
+    directories.clear();
 }
 
 urcl::config::config(const std::filesystem::path file) {
@@ -108,23 +170,35 @@ urcl::config::config(const std::filesystem::path file) {
     useLowercase = false;
     useUir = true;
     useRegs = true;
-    std::filesystem::path path = file.parent_path();
-    while (path != file.root_path()) {
-        if (std::filesystem::exists(path / "lsp.txt")) {
-            urcl::config trueConfig(path / "lsp.txt", file);
-            this->useCore = trueConfig.useCore;
-            this->useBasic = trueConfig.useBasic;
-            this->useComplex = trueConfig.useComplex;
-            this->useStandard = trueConfig.useStandard;
-            this->useIris = trueConfig.useIris;
-            this->useUrcx = trueConfig.useUrcx;
-            this->useLowercase = trueConfig.useLowercase;
-            this->useUir = trueConfig.useUir;
-            this->useRegs = trueConfig.useRegs;
-            this->includes = std::move(trueConfig.includes);
+    std::filesystem::path path = find(file.parent_path(), file.root_path());
+    if (path != "") {
+        std::shared_ptr<const urcl::config::parsed_file> trueConfig = load(path);
+        this->useCore = trueConfig->options.useCore;
+        this->useBasic = trueConfig->options.useBasic;
+        this->useComplex = trueConfig->options.useComplex;
+        this->useStandard = trueConfig->options.useStandard;
+        this->useIris = trueConfig->options.useIris;
+        this->useUrcx = trueConfig->options.useUrcx;
+        this->useLowercase = trueConfig->options.useLowercase;
+        this->useUir = trueConfig->options.useUir;
+        this->useRegs = trueConfig->options.useRegs;
+
+        // the first line of paths naming this file lists its includes
+        std::error_code error;
+        std::filesystem::path source = std::filesystem::weakly_canonical(file, error);
+        for (const std::vector<std::pair<std::filesystem::path, std::filesystem::path>>& paths : trueConfig->includes) {
+            auto found = std::find_if(paths.begin(), paths.end(), [&file, &source](const std::pair<std::filesystem::path, std::filesystem::path>& include) {
+                if (include.second != "") return include.second == source;
+                // the path didn't exist when lsp.txt was read, it may have been created since
+                std::error_code error;
+                return std::filesystem::equivalent(include.first, file, error);
+            });
+            if (found == paths.end()) continue;
+            for (auto include = paths.begin(); include != paths.end(); ++include) {
+                if (include != found) this->includes.push_back(include->first);
+            }
             break;
         }
-        path = path.parent_path();
     }
     if (file.extension() == ".uir") {
         this->useUir = true;
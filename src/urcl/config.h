@@ -2,6 +2,9 @@
 #define CONFIG_H
 
 #include <filesystem>
+#include <memory>
+#include <mutex>
+#include <unordered_map>
 #include <vector>
 
 namespace urcl {
@@ -20,8 +23,21 @@ namespace urcl {
 
             config(std::filesystem::path file);
             config();
+
+            // drop cached lookups that depend on file, lsp.txt files are otherwise only reread when their mtime changes
+            static void invalidate(const std::filesystem::path& file);
+            // lookups are only cached while every lsp.txt that is created or deleted gets invalidated
+            static void watch(bool enabled);
         private:
-            config(std::filesystem::path file, const std::filesystem::path& src);
+            struct parsed_file;
+            static std::shared_ptr<const parsed_file> load(const std::filesystem::path& file);
+            static std::filesystem::path find(const std::filesystem::path& directory, const std::filesystem::path& root);
+
+            static std::mutex cacheLock;
+            static bool watched;
+            // directory -> lsp.txt that applies to it, empty when there is none
+            static std::unordered_map<std::filesystem::path, std::filesystem::path> directories;
+            static std::unordered_map<std::filesystem::path, std::shared_ptr<const parsed_file>> files;
     };
 }
 
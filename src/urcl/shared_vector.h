@@ -0,0 +1,75 @@
+#ifndef SHARED_VECTOR_H
+#define SHARED_VECTOR_H
+
+#include <atomic>
+#include <cstddef>
+#include <iterator>
+#include <memory>
+#include <vector>
+
+namespace urcl {
+    // A vector whose elements are shared by its copies. Copying only copies the
+    // pointers, an element is copied by edit() when another copy still holds it.
+    template<typename T> class shared_vector {
+        public:
+            size_t size() const {
+                return elements.size();
+            }
+
+            bool empty() const {
+                return elements.empty();
+            }
+
+            size_t capacity() const {
+                return elements.capacity();
+            }
+
+            const T& operator[](size_t idx) const {
+                return *elements[idx];
+            }
+
+            T& edit(size_t idx) {
+                std::shared_ptr<T>& element = elements[idx];
+                if (element.use_count() > 1) {
+                    element = std::make_shared<T>(*element);
+                } else {
+                    // pairs with the release of the last other owner, whose reads have to finish before this write
+                    std::atomic_thread_fence(std::memory_order_acquire);
+                }
+                return *element;
+            }
+
+            void replace(size_t idx, T&& value) {
+                elements[idx] = std::make_shared<T>(std::move(value));
+            }
+
+            void reserve(size_t count) {
+                elements.reserve(count);
+            }
+
+            void clear() {
+                elements.clear();
+            }
+
+            void push_back(T&& value) {
+                elements.push_back(std::make_shared<T>(std::move(value)));
+            }
+
+            void insert(size_t idx, std::vector<T>&& values) {
+                std::vector<std::shared_ptr<T>> inserted;
+                inserted.reserve(values.size());
+                for (T& value : values) {
+                    inserted.push_back(std::make_shared<T>(std::move(value)));
+                }
+                elements.insert(elements.begin() + idx, std::make_move_iterator(inserted.begin()), std::make_move_iterator(inserted.end()));
+            }
+
+            void erase(size_t start, size_t end) {
+                elements.erase(elements.begin() + start, elements.begin() + end);
+            }
+        private:
+            std::vector<std::shared_ptr<T>> elements;
+    };
+}
+
+#endif
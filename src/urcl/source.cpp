@@ -1,29 +1,211 @@
 #include "source.h"
 #include "../util.h"
+#include "../stats.h"
 #include "defines.h"
 
+#include <algorithm>
+#include <array>
 #include <cctype>
+#include <cerrno>
+#include <charconv>
+#include <cstdlib>
 #include <fstream>
 #include <lsp/types.h>
 #include <string>
 #include <cstring>
 #include <cuchar>
+#include <type_traits>
 
 typedef unsigned int uint;
 
-urcl::source::source() {}
+// what the first character of a token makes it, for the lexer in parseLine
+namespace {
+    enum char_class : uint8_t {
+        other_char,
+        whitespace_char,
+        digit_char,
+        sign_char,
+        label_char,
+        symbol_char,
+        register_char,
+        stack_char,
+        counter_char,
+        memory_char,
+        port_char,
+        relative_char,
+        open_bracket_char,
+        close_bracket_char,
+        constant_char,
+        quote_char,
+        apostrophe_char,
+        comparison_char,
+        slash_char
+    };
+
+    constexpr std::array<char_class, 256> CHAR_CLASSES = [] {
+        std::array<char_class, 256> result{};
+        for (unsigned char c : {' ', '\t', '\r'}) result[c] = whitespace_char;
+        for (unsigned char c = '0'; c <= '9'; ++c) result[c] = digit_char;
+        for (unsigned char c : {'+', '-'}) result[c] = sign_char;
+        for (unsigned char c : {'R', 'r', '$'}) result[c] = register_char;
+        for (unsigned char c : {'S', 's'}) result[c] = stack_char;
+        for (unsigned char c : {'P', 'p'}) result[c] = counter_char;
+        for (unsigned char c : {'M', 'm', '#'}) result[c] = memory_char;
+        for (unsigned char c : {'<', '>', '='}) result[c] = comparison_char;
+        result['.'] = label_char;
+        result['!'] = symbol_char;
+        result['%'] = port_char;
+        result['~'] = relative_char;
+        result['['] = open_bracket_char;
+        result[']'] = close_bracket_char;
+        result['@'] = constant_char;
+        result['"'] = quote_char;
+        result['\''] = apostrophe_char;
+        result['/'] = slash_char;
+        return result;
+    }();
+
+    urcl::token& addToken(std::vector<urcl::token>& tokens, urcl::token::types_t type, uint32_t column, std::string_view original = {}) {
+        urcl::token& token = tokens.emplace_back();
+        token.type = type;
+        token.original = original;
+        token.column = column;
+        return token;
+    }
+
+    // copies line[start, end), end can be one past the last character when a string or character runs
+    // into the end of the line, the terminating null is then part of the token
+    std::string tokenText(const std::string& line, size_t start, size_t end) {
+        if (start >= end) return "";
+        std::string result = line.substr(start, end - start);
+        result.resize(end - start, '\0');
+        return result;
+    }
+
+    // number has already been checked by util::isFloat, so both paths see the same digits
+    bool parseReal(std::string_view number, long double& value) {
+#if defined(_LIBCPP_VERSION)
+        // libc++ has no floating point from_chars for long double
+        std::string copy(number);
+        char *end;
+        errno = 0;
+        value = std::strtold(copy.c_str(), &end);
+        return end != copy.c_str() && errno != ERANGE;
+#else
+        return std::from_chars(number.data(), number.data() + number.length(), value).ec == std::errc();
+#endif
+    }
+}
+
+// rough heap usage of the containers held by a source, assuming node based hash tables
+namespace {
+    size_t heapBytes(const std::string& str);
+    size_t heapBytes(const std::filesystem::path& path);
+    size_t heapBytes(const urcl::token& token);
+    size_t heapBytes(const urcl::line_state& state);
+    size_t heapBytes(const urcl::define_target& target);
+    template<typename T> requires std::is_trivially_copyable_v<T> size_t heapBytes(const T&);
+    template<typename A, typename B> size_t heapBytes(const std::pair<A, B>& pair);
+    template<typename T> size_t heapBytes(const std::vector<T>& vector);
+    template<typename K, typename V> size_t heapBytes(const std::unordered_map<K, V>& map);
+    template<typename K> size_t heapBytes(const std::unordered_set<K>& set);
+    template<typename T> size_t heapBytes(const urcl::shared_vector<T>& vector, std::unordered_set<const void *>& counted);
+    size_t heapBytes(const std::shared_ptr<const std::unordered_set<std::string>>& set, std::unordered_set<const void *>& counted);
+
+    size_t heapBytes(const std::string& str) {
+        // short strings live inside the object
+        static const size_t inlineCapacity = std::string().capacity();
+        return str.capacity() > inlineCapacity ? str.capacity() + 1 : 0;
+    }
+
+    size_t heapBytes(const std::filesystem::path& path) {
+        return (path.native().capacity() + 1) * sizeof(std::filesystem::path::value_type);
+    }
+
+    size_t heapBytes(const urcl::token& token) {
+        return heapBytes(token.original) + heapBytes(token.strVal) + heapBytes(token.parse_error) + heapBytes(token.parse_warning);
+    }
 
-urcl::source::source(const std::vector<std::string>& source, const urcl::config& config) {
+    size_t heapBytes(const urcl::line_state& state) {
+        return heapBytes(state.names) + heapBytes(state.definitionErrors) + heapBytes(state.checkErrors);
+    }
+
+    size_t heapBytes(const urcl::define_target& target) {
+        return heapBytes(target.last);
+    }
+
+    template<typename T> requires std::is_trivially_copyable_v<T> size_t heapBytes(const T&) {
+        return 0;
+    }
+
+    template<typename A, typename B> size_t heapBytes(const std::pair<A, B>& pair) {
+        return heapBytes(pair.first) + heapBytes(pair.second);
+    }
+
+    template<typename T> size_t heapBytes(const std::vector<T>& vector) {
+        size_t result = vector.capacity() * sizeof(T);
+        for (const T& element : vector) {
+            result += heapBytes(element);
+        }
+        return result;
+    }
+
+    template<typename K, typename V> size_t heapBytes(const std::unordered_map<K, V>& map) {
+        // bucket array, then a node per element holding the next pointer, the cached hash and the value
+        size_t result = map.bucket_count() * sizeof(void *) + map.size() * (sizeof(std::pair<const K, V>) + 2 * sizeof(void *));
+        for (const std::pair<const K, V>& element : map) {
+            result += heapBytes(element.first) + heapBytes(element.second);
+        }
+        return result;
+    }
+
+    template<typename K> size_t heapBytes(const std::unordered_set<K>& set) {
+        size_t result = set.bucket_count() * sizeof(void *) + set.size() * (sizeof(K) + 2 * sizeof(void *));
+        for (const K& element : set) {
+            result += heapBytes(element);
+        }
+        return result;
+    }
+
+    // shared blocks belong to whichever holder is counted first, the control block is counted with them
+    template<typename T> size_t heapBytes(const urcl::shared_vector<T>& vector, std::unordered_set<const void *>& counted) {
+        size_t result = vector.capacity() * sizeof(std::shared_ptr<T>);
+        for (size_t i = 0; i < vector.size(); ++i) {
+            if (!counted.insert(&vector[i]).second) continue;
+            result += sizeof(T) + 2 * sizeof(void *) + heapBytes(vector[i]);
+        }
+        return result;
+    }
+
+    size_t heapBytes(const std::shared_ptr<const std::unordered_set<std::string>>& set, std::unordered_set<const void *>& counted) {
+        // a moved-from source holds none
+        if (!set || !counted.insert(set.get()).second) return 0;
+        return sizeof(*set) + 2 * sizeof(void *) + heapBytes(*set);
+    }
+}
+
+namespace {
+    // dialect sets of a source that was never built from a document
+    const std::shared_ptr<const std::unordered_set<std::string>>& noNames() {
+        static const std::shared_ptr<const std::unordered_set<std::string>> empty = std::make_shared<const std::unordered_set<std::string>>();
+        return empty;
+    }
+}
+
+urcl::source::source() : constants(noNames()), instructions(noNames()), macros(noNames()), ports(noNames()) {}
+
+urcl::source::source(const std::vector<std::string>& source, const urcl::config& config) : constants(noNames()) {
+    stats::scope scope("parse");
     this->code.reserve(source.size());
 
     // init macros
-    macros = {"@DEFINE"};
+    std::unordered_set<std::string> macros = {"@DEFINE"};
     if (config.useUrcx) {
         macros.insert(urcl::defines::URCX_MACROS.begin(), urcl::defines::URCX_MACROS.end());
     }
 
     // init ports
-    ports = urcl::defines::STD_PORTS;
+    std::unordered_set<std::string> ports = urcl::defines::STD_PORTS;
     if (config.useUrcx) {
         ports.insert(urcl::defines::URCX_PORTS.begin(), urcl::defines::URCX_PORTS.end());
     }
@@ -32,7 +214,7 @@ urcl::source::source(const std::vector<std::string>& source, const urcl::config&
     }
 
     // init instructions
-    instructions = urcl::defines::HEADERS;
+    std::unordered_set<std::string> instructions = urcl::defines::HEADERS;
     instructions.insert(urcl::defines::OTHER_INSTRUCTIONS.begin(), urcl::defines::OTHER_INSTRUCTIONS.end());
     if (config.useCore) {
         instructions.insert(urcl::defines::CORE_INSTRUCTIONS.begin(), urcl::defines::CORE_INSTRUCTIONS.end());
@@ -55,50 +237,432 @@ urcl::source::source(const std::vector<std::string>& source, const urcl::config&
     if (config.useUrcx && config.useIris) {
         instructions.insert(urcl::defines::IRIX_INSTRUCTIONS.begin(), urcl::defines::IRIX_INSTRUCTIONS.end());
     }
+    this->macros = std::make_shared<const std::unordered_set<std::string>>(std::move(macros));
+    this->ports = std::make_shared<const std::unordered_set<std::string>>(std::move(ports));
+    this->instructions = std::make_shared<const std::unordered_set<std::string>>(std::move(instructions));
 
     bool inComment = false;
-    for (const std::string& line : source) {
-        this->code.emplace_back(parseLine(line, inComment, config));
+    this->lines.reserve(source.size());
+    for (size_t i = 0; i < source.size(); ++i) {
+        this->code.push_back(parseLine(source[i], inComment, config));
+        urcl::line_state state;
+        state.inComment = inComment;
+        this->lines.push_back(std::move(state));
     }
 }
 
-void urcl::source::updateReferences(const std::unordered_map<std::filesystem::path, urcl::source>& all, const urcl::config& config) {
-    for (std::filesystem::path path : config.includes) {
+void urcl::source::update(const std::vector<std::string>& document, urcl::line_number start, urcl::line_number end, urcl::line_number count, const urcl::config& config) {
+    stats::scope scope("parse");
+    bool previous = end > 0 && lines[end - 1].inComment;
+    bool inComment = start > 0 && lines[start - 1].inComment;
+    for (urcl::line_number i = start; i < end; ++i) {
+        removeDefinition(i);
+    }
+    code.erase(start, end);
+    lines.erase(start, end);
+    shiftDefinitions(end, (int64_t)count - (int64_t)(end - start));
+
+    std::vector<std::vector<urcl::token>> newCode;
+    std::vector<urcl::line_state> newLines(count);
+    newCode.reserve(count);
+    for (urcl::line_number i = 0; i < count; ++i) {
+        newCode.emplace_back(parseLine(document[start + i], inComment, config));
+        newLines[i].inComment = inComment;
+    }
+    code.insert(start, std::move(newCode));
+    lines.insert(start, std::move(newLines));
+
+    // opening or closing a block comment changes how the following lines lex
+    for (urcl::line_number i = start + count; i < code.size() && inComment != previous; ++i) {
+        previous = lines[i].inComment;
+        removeDefinition(i);
+        code.replace(i, parseLine(document[i], inComment, config));
+        urcl::line_state state;
+        state.inComment = inComment;
+        lines.replace(i, std::move(state));
+    }
+}
+
+void urcl::source::updateReferences(const std::unordered_map<std::filesystem::path, std::shared_ptr<const urcl::source>>& all, const urcl::config& config, const std::function<void(size_t)>& loaded) {
+    stats::scope scope("updateReferences");
+    includes.clear();
+    for (urcl::line_number i = 0; i < lines.size(); ++i) {
+        if (!lines[i].dirty) lines.edit(i).dirty = true;
+    }
+    for (const std::filesystem::path& path : config.includes) {
         bool found = false;
-        for (std::pair<std::filesystem::path, urcl::source> loaded : all) {
+        for (const std::pair<const std::filesystem::path, std::shared_ptr<const urcl::source>>& loaded : all) {
             if (std::filesystem::exists(path) && std::filesystem::equivalent(path, loaded.first)) {
                 found = true;
                 includes.emplace(path, loaded.second);
             }
         }
-        if (found) continue;
+        if (found) {
+            if (loaded) loaded(0);
+            continue;
+        }
+        stats::scope load("loadInclude");
+        load.document(path);
         std::vector<std::string> document;
         std::ifstream in(path);
         
+        size_t bytes = 0;
         std::string line;
         while (std::getline(in, line)) {
+            bytes += line.size() + 1;
             document.emplace_back(std::move(line));
         }
 
-        urcl::source fileSrc(document, config);
-        includes.emplace(path, fileSrc);
+        includes.emplace(path, std::make_shared<const urcl::source>(document, config));
+        if (loaded) loaded(bytes);
+    }
+
+    // every name an include defined or still defines has to be resolved again
+    for (const std::pair<const std::string, std::pair<std::filesystem::path, urcl::line_number>>& definition : includeDefines) {
+        changedNames.insert(definition.first);
+    }
+    for (const std::pair<const std::string, std::pair<std::filesystem::path, urcl::line_number>>& symbol : includeSymbols) {
+        changedNames.insert(symbol.first);
+    }
+    includeDefines.clear();
+    includeSymbols.clear();
+    includeBits = 0;
+    for (const std::pair<const std::filesystem::path, std::shared_ptr<const urcl::source>>& include : includes) {
+        updateIncludeDefinitions(*include.second, include.first);
     }
 }
 
 void urcl::source::updateDefinitions(const std::filesystem::path& loc, const urcl::config& config) {
-    if (config.useIris && !config.useStandard) bits = 16;
-    updateDefinitions(*this, loc, true);
+    stats::scope scope("updateDefinitions");
+    for (urcl::line_number i = 0; i < code.size(); ++i) {
+        if (!lines[i].scanned) addDefinition(i);
+    }
+
+    bits = config.useIris && !config.useStandard ? 16 : 8;
+    bits = std::max(bits, includeBits);
+    for (urcl::line_number i = 0; i < lines.size(); ++i) {
+        bits = std::max(bits, lines[i].bits);
+    }
+
+    if (objectsChanged) {
+        updateObjects();
+        for (std::pair<const std::string, std::pair<urcl::object_id, urcl::line_number>>& label : labelDefs) {
+            label.second.first = objectAt(label.second.second);
+        }
+    }
+    for (const std::string& name : changedNames) {
+        resolveDefinition(name, loc);
+    }
+    markChangedDefinitions();
+    if (!changedNames.empty()) definesResolved = false;
+    changedNames.clear();
+    objectsChanged = false;
 }
 
-void urcl::source::updateDefinitions(urcl::source& code, const std::filesystem::path& loc, bool base) {
-    urcl::object_id nextObjId = 1;
-    urcl::object_id currentObjId = 0;
-    urcl::source& source = *this;
-    for (size_t i = 0; i < code.code.size(); ++i) {
-        std::vector<urcl::token>& line = code.code[i];
+void urcl::source::addDefinition(urcl::line_number row) {
+    urcl::line_state& state = lines.edit(row);
+    const std::vector<urcl::token>& line = code[row];
+    state.scanned = true;
+    for (size_t k = 0; k < line.size(); ++k) {
+        const urcl::token& token = line[k];
+        switch (token.type) {
+            case (urcl::token::macro):
+                if (token.strVal != "@DEFINE") return;
+                for (size_t j = k + 1; j < line.size(); ++j) {
+                    if (line[j].type == urcl::token::comment) continue;
+                    state.definitionKind = urcl::define_definition;
+                    state.definition = j;
+                    addDefinitionLine(defineLines[line[j].original], row);
+                    changedNames.insert(line[j].original);
+                    break;
+                }
+                return;
+            case (urcl::token::symbol):
+                state.definition = k;
+                if (token.original.length() >= 3 && token.original.substr(0, 3) == "!!!") {
+                    state.definitionKind = urcl::object_definition;
+                    addObject(urcl::sub_object::open, row);
+                } else if (token.original.length() >= 2 && token.original.substr(0, 2) == "!!") {
+                    state.definitionKind = urcl::object_definition;
+                    addObject(urcl::sub_object::close, row);
+                } else {
+                    state.definitionKind = urcl::symbol_definition;
+                    addDefinitionLine(symbolLines[token.original], row);
+                    changedNames.insert(token.original);
+                }
+                return;
+            case (urcl::token::label):
+                state.definitionKind = urcl::label_definition;
+                state.definition = k;
+                addDefinitionLine(labelLines[token.original], row);
+                changedNames.insert(token.original);
+                return;
+            case (urcl::token::instruction):
+                if (token.strVal != "BITS") return;
+                for (size_t j = k + 1; j < line.size(); ++j) {
+                    if (line[j].type == urcl::token::comment) continue;
+                    if (line[j].type == urcl::token::comparison) continue;
+                    if (line[j].value.literal > UINT16_MAX) break;
+                    state.bits = std::max(state.bits, (uint16_t)line[j].value.literal);
+                    break;
+                }
+                for (size_t j = k + 1; j < line.size(); ++j) {
+                    if (line[j].type != urcl::token::literal) continue;
+                    state.bits = std::max(state.bits, (uint16_t)line[j].value.literal);
+                }
+                return;
+            case (urcl::token::comment):
+                break;
+            default:
+                return;
+        }
+    }
+}
+
+void urcl::source::removeDefinition(urcl::line_number row) {
+    const urcl::line_state& state = lines[row];
+    if (state.definitionKind == urcl::no_definition) return;
+    const std::string& name = code[row][state.definition].original;
+    auto remove = [&name, row](std::unordered_map<std::string, std::vector<urcl::line_number>>& definitions) {
+        std::vector<urcl::line_number>& rows = definitions.at(name);
+        rows.erase(std::lower_bound(rows.begin(), rows.end(), row));
+        if (rows.empty()) definitions.erase(name);
+    };
+    switch (state.definitionKind) {
+        case (urcl::label_definition):
+            remove(labelLines);
+            changedNames.insert(name);
+            break;
+        case (urcl::define_definition):
+            remove(defineLines);
+            changedNames.insert(name);
+            break;
+        case (urcl::symbol_definition):
+            remove(symbolLines);
+            changedNames.insert(name);
+            break;
+        case (urcl::object_definition):
+            objectDefs.erase(std::lower_bound(objectDefs.begin(), objectDefs.end(), row, [](const urcl::object_delimiter& delimiter, urcl::line_number line) {
+                return delimiter.line < line;
+            }));
+            objectsChanged = true;
+            break;
+        default:
+            break;
+    }
+}
+
+void urcl::source::addDefinitionLine(std::vector<urcl::line_number>& rows, urcl::line_number row) {
+    rows.insert(std::lower_bound(rows.begin(), rows.end(), row), row);
+}
+
+void urcl::source::addObject(urcl::sub_object type, urcl::line_number row) {
+    auto position = std::lower_bound(objectDefs.begin(), objectDefs.end(), row, [](const urcl::object_delimiter& delimiter, urcl::line_number line) {
+        return delimiter.line < line;
+    });
+    objectDefs.insert(position, urcl::object_delimiter{type, row});
+    objectsChanged = true;
+}
+
+void urcl::source::shiftDefinitions(urcl::line_number from, int64_t delta) {
+    if (delta == 0) return;
+    auto shift = [from, delta](urcl::line_number& line) {
+        if (line >= from) line += delta;
+    };
+    for (std::unordered_map<std::string, std::vector<urcl::line_number>> *definitions : {&labelLines, &defineLines, &symbolLines}) {
+        for (std::pair<const std::string, std::vector<urcl::line_number>>& rows : *definitions) {
+            // rows are sorted, only the tail after the edit moves
+            for (auto it = std::lower_bound(rows.second.begin(), rows.second.end(), from); it != rows.second.end(); ++it) {
+                shift(*it);
+            }
+        }
+    }
+    for (std::pair<const std::string, std::pair<urcl::object_id, urcl::line_number>>& label : labelDefs) {
+        shift(label.second.second);
+    }
+    for (std::unordered_map<std::string, std::pair<std::filesystem::path, urcl::line_number>> *definitions : {&definesDefs, &symbolDefs}) {
+        for (std::pair<const std::string, std::pair<std::filesystem::path, urcl::line_number>>& definition : *definitions) {
+            if (!includes.contains(definition.second.first)) shift(definition.second.second);
+        }
+    }
+    auto position = std::lower_bound(objectDefs.begin(), objectDefs.end(), from, [](const urcl::object_delimiter& delimiter, urcl::line_number line) {
+        return delimiter.line < line;
+    });
+    for (; position != objectDefs.end(); ++position) {
+        shift(position->line);
+    }
+}
+
+void urcl::source::resolveDefinition(const std::string& name, const std::filesystem::path& loc) {
+    // the first definition of a label wins, later ones are errors
+    if (labelDefs.contains(name) || labelLines.contains(name)) {
+        if (labelLines.contains(name)) {
+            const std::vector<urcl::line_number>& rows = labelLines.at(name);
+            for (urcl::line_number row : rows) {
+                clearDefinitionErrors(row);
+            }
+            labelDefs[name] = {objectAt(rows[0]), rows[0]};
+            for (size_t i = 1; i < rows.size(); ++i) {
+                addDefinitionError(rows[i], "Label already defined", false);
+            }
+        } else {
+            labelDefs.erase(name);
+        }
+    }
+
+    // defines and symbols from includes take precedence over the last one in the file
+    if (includeDefines.contains(name)) {
+        definesDefs[name] = includeDefines.at(name);
+    } else if (defineLines.contains(name)) {
+        definesDefs[name] = {loc, defineLines.at(name).back()};
+    } else {
+        definesDefs.erase(name);
+    }
+    if (includeSymbols.contains(name)) {
+        symbolDefs[name] = includeSymbols.at(name);
+    } else if (symbolLines.contains(name)) {
+        symbolDefs[name] = {loc, symbolLines.at(name).back()};
+    } else {
+        symbolDefs.erase(name);
+    }
+}
+
+void urcl::source::updateObjects() {
+    bool inside = false;
+    urcl::object_id opened = 0;
+    for (urcl::object_delimiter& delimiter : objectDefs) {
+        clearDefinitionErrors(delimiter.line);
+        if (delimiter.type == urcl::sub_object::open) {
+            delimiter.id = ++opened;
+            if (inside) addDefinitionError(delimiter.line, "Opened sub-object while already within one", true);
+            inside = true;
+        } else {
+            if (!inside) addDefinitionError(delimiter.line, "Closed sub-object without opening one", true);
+            inside = false;
+        }
+    }
+}
+
+void urcl::source::addDefinitionError(urcl::line_number row, const std::string& error, bool replace) {
+    urcl::line_state& state = lines.edit(row);
+    urcl::token& token = code.edit(row)[state.definition];
+    if (!replace && token.parse_error != "") return;
+    state.definitionErrors.emplace_back(state.definition, token.parse_error);
+    token.parse_error = error;
+    state.dirty = true;
+}
+
+void urcl::source::clearDefinitionErrors(urcl::line_number row) {
+    if (lines[row].definitionErrors.empty()) return;
+    urcl::line_state& state = lines.edit(row);
+    std::vector<urcl::token>& line = code.edit(row);
+    for (auto error = state.definitionErrors.rbegin(); error != state.definitionErrors.rend(); ++error) {
+        line[error->first].parse_error = error->second;
+    }
+    state.definitionErrors.clear();
+    state.dirty = true;
+}
+
+void urcl::source::markChangedDefinitions() {
+    if (changedNames.empty() && !objectsChanged) return;
+    std::unordered_set<std::string> changed = changedNames;
+
+    // a define whose value names a changed define resolves differently as well
+    std::unordered_map<std::string, std::vector<std::string>> dependents;
+    for (const std::pair<const std::string, std::pair<std::filesystem::path, urcl::line_number>>& definition : definesDefs) {
+        urcl::token name{urcl::token::name, definition.first, "", {0}, "", "", 0};
+        const urcl::token *value = getDefineValue(name, *this);
+        if (value == nullptr) continue;
+        dependents[value->original].push_back(definition.first);
+    }
+    std::vector<std::string> queue(changed.begin(), changed.end());
+    while (!queue.empty()) {
+        std::string name = std::move(queue.back());
+        queue.pop_back();
+        if (!dependents.contains(name)) continue;
+        for (const std::string& dependent : dependents.at(name)) {
+            if (changed.insert(dependent).second) queue.push_back(dependent);
+        }
+    }
+
+    for (urcl::line_number i = 0; i < lines.size(); ++i) {
+        if (lines[i].dirty) continue;
+        for (const std::string& name : lines[i].names) {
+            if (changed.contains(name) || (objectsChanged && name[0] == '.')) {
+                lines.edit(i).dirty = true;
+                break;
+            }
+        }
+    }
+}
+
+void urcl::source::resolveDefines() {
+    auto isLink = [this](const urcl::token& link) {
+        if (link.type == urcl::token::constant) return !constants->contains(util::strToUpper(link.original.substr(1)));
+        return link.type == urcl::token::name;
+    };
+
+    // every chain is followed until it reaches a define that was already resolved, so each link is walked once
+    defineTargets.clear();
+    std::vector<std::string> path;
+    std::unordered_map<std::string, size_t> onPath;
+    for (const std::pair<const std::string, std::pair<std::filesystem::path, urcl::line_number>>& definition : definesDefs) {
+        if (defineTargets.contains(definition.first)) continue;
+        path.clear();
+        onPath.clear();
+        urcl::define_target end;
+        size_t cycle = SIZE_MAX;
+        std::string name = definition.first;
+        while (true) {
+            auto known = defineTargets.find(name);
+            if (known != defineTargets.end()) {
+                end = known->second;
+                break;
+            }
+            if (!definesDefs.contains(name)) {
+                end.result = urcl::define_result::undefined;
+                break;
+            }
+            auto repeat = onPath.find(name);
+            if (repeat != onPath.end()) {
+                cycle = repeat->second;
+                break;
+            }
+            onPath.emplace(name, path.size());
+            path.push_back(name);
+            urcl::token link{urcl::token::name, name, "", {0}, "", "", 0};
+            const urcl::token *value = getDefineValue(link, *this);
+            if (value == nullptr) {
+                end.result = urcl::define_result::undefined;
+                break;
+            }
+            if (!isLink(*value)) {
+                end.last = name;
+                break;
+            }
+            name = value->original;
+        }
+        for (size_t i = 0; i < path.size(); ++i) {
+            urcl::define_target& target = defineTargets[path[i]];
+            if (cycle != SIZE_MAX) {
+                // names leading into a cycle count the cycle once
+                target.result = urcl::define_result::recursive;
+                target.depth = path.size() - std::min(i, cycle);
+            } else {
+                target = end;
+                target.depth = end.depth + path.size() - i;
+            }
+        }
+    }
+    definesResolved = true;
+}
+
+void urcl::source::updateIncludeDefinitions(const urcl::source& include, const std::filesystem::path& loc) {
+    for (size_t i = 0; i < include.code.size(); ++i) {
+        const std::vector<urcl::token>& line = include.code[i];
         bool exit = false;
         for (size_t k = 0; k < line.size(); ++k) {
-            urcl::token& token = line[k];
+            const urcl::token& token = line[k];
             if (exit) break;
             switch (token.type) {
                 case (urcl::token::macro):
@@ -106,38 +670,16 @@ void urcl::source::updateDefinitions(urcl::source& code, const std::filesystem::
                     if (token.strVal != "@DEFINE") break;
                     for (size_t j = k + 1; j < line.size(); ++j) {
                         if (line[j].type == urcl::token::comment) continue;
-                        source.definesDefs[line[j].original] = {loc, i};
+                        includeDefines[line[j].original] = {loc, i};
+                        changedNames.insert(line[j].original);
                         break;
                     }
                     break;
                 case (urcl::token::symbol):
                     exit = true;
-                    if (token.original.length() >= 3 && token.original.substr(0, 3) == "!!!") {
-                        source.objectDefs.emplace_back(urcl::sub_object::open, i);
-                        if (currentObjId != 0) {
-                            token.parse_error = "Opened sub-object while already within one";
-                        }
-                        currentObjId = nextObjId++;
-                    } else if (token.original.length() >= 2 && token.original.substr(0, 2) == "!!") {
-                        source.objectDefs.emplace_back(urcl::sub_object::close, i);
-                        if (currentObjId == 0) {
-                            token.parse_error = "Closed sub-object without opening one";
-                        }
-                        currentObjId = 0;
-                    } else {
-                        source.symbolDefs[token.original] = {loc, i};
-                    }
-                    break;
-                case (urcl::token::label):
-                    exit = true;
-                    if (!base) break;
-                    if (source.labelDefs.contains(token.original)) {
-                        if (token.parse_error == "") {
-                            token.parse_error = "Label already defined";
-                        }
-                        break;
-                    }
-                    source.labelDefs[token.original] = {currentObjId, i};
+                    if (token.original.length() >= 2 && token.original.substr(0, 2) == "!!") break;
+                    includeSymbols[token.original] = {loc, i};
+                    changedNames.insert(token.original);
                     break;
                 case (urcl::token::instruction):
                     if (token.strVal != "BITS") {
@@ -148,7 +690,7 @@ void urcl::source::updateDefinitions(urcl::source& code, const std::filesystem::
                         if (line[j].type == urcl::token::comment) continue;
                         if (line[j].type == urcl::token::comparison) continue;
                         if (line[j].value.literal > UINT16_MAX) break;
-                        bits = std::max(bits, (uint16_t)line[j].value.literal);
+                        includeBits = std::max(includeBits, (uint16_t)line[j].value.literal);
                         break;
                     }
                     exit = true;
@@ -161,241 +703,259 @@ void urcl::source::updateDefinitions(urcl::source& code, const std::filesystem::
             }
         }
     }
-    if (!base) return;
-    for (std::pair<const std::filesystem::path, urcl::source>& data : source.includes) {
-        source.updateDefinitions(data.second, data.first, false);
-    }
 }
 
 void urcl::source::updateErrors(const urcl::config& config) {
+    stats::scope scope("updateErrors");
     // build constants
     std::unordered_set<std::string> constants = urcl::defines::STD_CONSTS;
 
     if (config.useUrcx) {
         constants.insert(urcl::defines::URCX_CONSTS.begin(), urcl::defines::URCX_CONSTS.end());
     }
-    this->constants = std::move(constants);
-
-    urcl::object_id nextObjId = 1;
-    urcl::object_id currentObjId = 0;
-    for (std::vector<urcl::token>& line : code) {
-        bool expect = true;
-        bool inArray = false;
-        bool inUir = false;
-        int operand = -1;
-        int uirOperand = 0;
-        uint32_t instColumn = 0;
-        std::string_view inst;
-        const std::vector<urcl::defines::op_type> *operands = nullptr;
-        for (urcl::token& token : line) {
-            if (inArray && token.type == urcl::token::bracket && token.original == "]") {
-                inArray = false;
-                continue;
-            }
+    if (constants != *this->constants) {
+        // a constant the implementation doesn't define is a define name, so chains may end elsewhere
+        this->constants = std::make_shared<const std::unordered_set<std::string>>(std::move(constants));
+        definesResolved = false;
+    }
+    if (!definesResolved) resolveDefines();
 
-            if (token.type == urcl::token::comment) continue;
+    for (urcl::line_number i = 0; i < code.size(); ++i) {
+        if (lines[i].dirty) checkLine(i, config);
+    }
+}
 
-            if (!inArray && !inUir) ++operand;
-            if (inUir) ++uirOperand;
-            if (operand == 0 && (token.type == urcl::token::label || token.type == urcl::token::symbol)) {
-                if (token.original.length() >= 3 && token.original.substr(0, 3) == "!!!") {
-                    currentObjId = nextObjId++;
-                } else if (token.original.length() >= 2 && token.original.substr(0, 2) == "!!") {
-                    currentObjId = 0;
-                }
-                expect = false;
-                continue;
-            }
+void urcl::source::checkLine(urcl::line_number row, const urcl::config& config) {
+    std::vector<urcl::token>& line = code.edit(row);
+    urcl::line_state& state = lines.edit(row);
+    for (uint32_t idx : state.checkErrors) {
+        line[idx].parse_error = "";
+    }
+    state.checkErrors.clear();
+    state.names.clear();
+    std::vector<bool> hadError(line.size());
+    for (size_t k = 0; k < line.size(); ++k) {
+        hadError[k] = line[k].parse_error != "";
+    }
 
-            if (!operands && (token.type == urcl::token::instruction || token.type == urcl::token::macro)) {
-                inst = std::string_view(token.strVal);
-                instColumn = token.column;
-                if (urcl::defines::INST_INFO.contains(token.strVal)) {
-                    operands = &urcl::defines::INST_INFO.at(token.strVal).second;
-                }
-            }
+    urcl::object_id currentObjId = objectAt(row);
+    bool expect = true;
+    bool inArray = false;
+    bool inUir = false;
+    int operand = -1;
+    int uirOperand = 0;
+    uint32_t instColumn = 0;
+    std::string_view inst;
+    const std::vector<urcl::defines::op_type> *operands = nullptr;
+    for (urcl::token& token : line) {
+        if (inArray && token.type == urcl::token::bracket && token.original == "]") {
+            inArray = false;
+            continue;
+        }
 
-            if (token.parse_error != "") continue;
+        if (token.type == urcl::token::comment) continue;
 
-            if (!inArray && token.type == urcl::token::bracket && token.original == "]") {
-                token.parse_error = "Closing bracket before opening bracket";
-                continue;
+        if (!inArray && !inUir) ++operand;
+        if (inUir) ++uirOperand;
+        if (operand == 0 && (token.type == urcl::token::label || token.type == urcl::token::symbol)) {
+            expect = false;
+            continue;
+        }
+
+        if (!operands && (token.type == urcl::token::instruction || token.type == urcl::token::macro)) {
+            inst = std::string_view(token.strVal);
+            instColumn = token.column;
+            if (urcl::defines::INST_INFO.contains(token.strVal)) {
+                operands = &urcl::defines::INST_INFO.at(token.strVal).second;
             }
+        }
 
-            if (operand == 1 && inst == "OUT" && token.column == instColumn + 3) {
-                if (urcl::defines::OUT_INFO.contains(token.strVal)) {
-                    operands = &urcl::defines::OUT_INFO.at(token.strVal).second;
-                }
-            } else if (token.type == urcl::token::port && operand == 1 && inst == "IN" && (config.useUir || config.useIris || token.column == instColumn + 2)) {
-                if (urcl::defines::IN_INFO.contains(token.strVal)) {
-                    operands = &urcl::defines::IN_INFO.at(token.strVal).second;
-                } else {
-                    operands = &urcl::defines::IN_DEFAULT;
-                }
+        if (token.parse_error != "") continue;
+
+        if (!inArray && token.type == urcl::token::bracket && token.original == "]") {
+            token.parse_error = "Closing bracket before opening bracket";
+            continue;
+        }
+
+        if (operand == 1 && inst == "OUT" && token.column == instColumn + 3) {
+            if (urcl::defines::OUT_INFO.contains(token.strVal)) {
+                operands = &urcl::defines::OUT_INFO.at(token.strVal).second;
             }
+        } else if (token.type == urcl::token::port && operand == 1 && inst == "IN" && (config.useUir || config.useIris || token.column == instColumn + 2)) {
+            if (urcl::defines::IN_INFO.contains(token.strVal)) {
+                operands = &urcl::defines::IN_INFO.at(token.strVal).second;
+            } else {
+                operands = &urcl::defines::IN_DEFAULT;
+            }
+        }
 
-            if (!inArray && !inUir && operands) {
-                if (operand >= 0 && operands->size() < (size_t)operand) {
-                    if (inst != "@DEBUG") token.parse_error = "Too many operands in language construct";
-                } else if (operand != 0) {
-                    urcl::defines::op_type op = operands->at(operand - 1);
-                    switch (op) {
-                        case (urcl::defines::op_type::inst): {
-                            if (token.type != urcl::token::instruction) {
-                                token.parse_error = "Unexpected operand type";
-                            }
-                            break;
+        if (!inArray && !inUir && operands) {
+            if (operand >= 0 && operands->size() < (size_t)operand) {
+                if (inst != "@DEBUG") token.parse_error = "Too many operands in language construct";
+            } else if (operand != 0) {
+                urcl::defines::op_type op = operands->at(operand - 1);
+                switch (op) {
+                    case (urcl::defines::op_type::inst): {
+                        if (token.type != urcl::token::instruction) {
+                            token.parse_error = "Unexpected operand type";
                         }
-                        case (urcl::defines::op_type::port): {
-                            if (token.type != urcl::token::port) {
-                                token.parse_error = "Expected port in operand";
-                            }
-                            break;
+                        break;
+                    }
+                    case (urcl::defines::op_type::port): {
+                        if (token.type != urcl::token::port) {
+                            token.parse_error = "Expected port in operand";
                         }
-                        case (urcl::defines::op_type::array): {
-                            if (token.type == urcl::token::bracket && token.original == "[") break;
-                            if ((config.useIris || config.useUrcx) && tokenIsBlank(token, *this)) break;
-                            if ((config.useIris || config.useUrcx) && tokenIsR0(token, *this)) break;
-                            if (!tokenIsImmediate(token, *this)) {
-                                token.parse_error = "Expected array or immediate value";
-                            }
-                            break;
+                        break;
+                    }
+                    case (urcl::defines::op_type::array): {
+                        if (token.type == urcl::token::bracket && token.original == "[") break;
+                        if ((config.useIris || config.useUrcx) && tokenIsBlank(token, *this)) break;
+                        if ((config.useIris || config.useUrcx) && tokenIsR0(token, *this)) break;
+                        if (!tokenIsImmediate(token, *this)) {
+                            token.parse_error = "Expected array or immediate value";
                         }
-                        case (urcl::defines::op_type::comparison): {
-                            if (token.type == urcl::token::comparison) break;
-                            ++operand;
-                            [[fallthrough]];
+                        break;
+                    }
+                    case (urcl::defines::op_type::comparison): {
+                        if (token.type == urcl::token::comparison) break;
+                        ++operand;
+                        [[fallthrough]];
+                    }
+                    case (urcl::defines::op_type::imm): {
+                        if (!tokenIsImmediate(token, *this)) {
+                            if (config.useUrcx && inst == "IMM" && tokenIsRegister(token, *this)) break;
+                            token.parse_error = "Expected immediate value in operand";
                         }
-                        case (urcl::defines::op_type::imm): {
-                            if (!tokenIsImmediate(token, *this)) {
-                                if (config.useUrcx && inst == "IMM" && tokenIsRegister(token, *this)) break;
-                                token.parse_error = "Expected immediate value in operand";
-                            }
-                            break;
+                        break;
+                    }
+                    case (urcl::defines::op_type::reg): {
+                        if (!tokenIsRegister(token, *this)) {
+                            token.parse_error = "Expected register in operand";
                         }
-                        case (urcl::defines::op_type::reg): {
-                            if (!tokenIsRegister(token, *this)) {
-                                token.parse_error = "Expected register in operand";
-                            }
+                        break;
+                    }
+                    case (urcl::defines::op_type::basicval): {
+                        if (tokenIsRegister(token, *this)) break;
+                        if (!config.useBasic) {
+                            token.parse_error = "Expected register in operand";
                             break;
                         }
-                        case (urcl::defines::op_type::basicval): {
-                            if (tokenIsRegister(token, *this)) break;
-                            if (!config.useBasic) {
-                                token.parse_error = "Expected register in operand";
-                                break;
-                            }
-                            if (!tokenIsImmediate(token, *this)) {
-                                token.parse_error = "Expected value in operand";
-                            }
-                            break;
+                        if (!tokenIsImmediate(token, *this)) {
+                            token.parse_error = "Expected value in operand";
                         }
-                        case (urcl::defines::op_type::val): {
-                            if (!tokenIsRegister(token, *this) && !tokenIsImmediate(token, *this)) {
-                                if ((config.useIris || config.useUrcx) && inst == "@DEFINE" && tokenIsBlank(token, *this)) break;
-                                token.parse_error = "Expected register or immediate value in operand";
-                            }
-                            break;
+                        break;
+                    }
+                    case (urcl::defines::op_type::val): {
+                        if (!tokenIsRegister(token, *this) && !tokenIsImmediate(token, *this)) {
+                            if ((config.useIris || config.useUrcx) && inst == "@DEFINE" && tokenIsBlank(token, *this)) break;
+                            token.parse_error = "Expected register or immediate value in operand";
                         }
+                        break;
                     }
                 }
-
             }
 
-            if (inUir && token.type != urcl::token::uir && !tokenIsImmediate(token, *this)) {
-                token.parse_error = "UIR values must be immediates";
-            }
+        }
 
-            if (operand == 1 && inst == "@DEFINE" && token.original[0] == '@') {
-                std::string copy = util::strToUpper(token.original.substr(1));
-                if (this->constants.contains(copy)) {
-                    token.parse_error = "Constant already defined by implementation";
-                }
-            }
+        if (inUir && token.type != urcl::token::uir && !tokenIsImmediate(token, *this)) {
+            token.parse_error = "UIR values must be immediates";
+        }
 
-            if (token.type == urcl::token::literal && inst == "BITS") {
-                bits = std::max(bits, (uint16_t)token.value.literal);
+        if (operand == 1 && inst == "@DEFINE" && token.original[0] == '@') {
+            std::string copy = util::strToUpper(token.original.substr(1));
+            if (this->constants->contains(copy)) {
+                token.parse_error = "Constant already defined by implementation";
             }
+        }
 
-            if (inArray && token.parse_error == "" && !tokenIsImmediate(token, *this) && token.type != urcl::token::string) {
-                if (!((config.useIris || config.useUrcx) && (tokenIsR0(token, *this) || tokenIsBlank(token, *this)))) {
-                    token.parse_error = "Array contents must be immediate values";
-                }
+        if (inArray && token.parse_error == "" && !tokenIsImmediate(token, *this) && token.type != urcl::token::string) {
+            if (!((config.useIris || config.useUrcx) && (tokenIsR0(token, *this) || tokenIsBlank(token, *this)))) {
+                token.parse_error = "Array contents must be immediate values";
             }
+        }
 
-            if (!expect) {
-                token.parse_error = "Extraneous token after language construct";
-            } else {
-                switch (token.type) {
-                    case (urcl::token::uir): {
-                        if (token.original == "[") {
-                            inUir = true;
-                            uirOperand = 0;
-                        } else {
-                            inUir = false;
-                            if (uirOperand != 2) {
-                                token.parse_error = "UIR value must contain exactly one token";
-                            }
-                        }
-                        break;
-                    }
-                    case (urcl::token::bracket): {
-                        if (token.original != "[") break;
-                        if (inArray) token.parse_error = "Nested array arguments not allowed";
-                        inArray = true;
-                        break;
-                    }
-                    case (urcl::token::label): {
-                        if (!labelDefs.contains(token.original)) {
-                            token.parse_error = "Undefined label";
-                        } else if (labelDefs.at(token.original).first != currentObjId) {
-                            token.parse_error = "Label defined outside of sub-object";
+        if (!expect) {
+            token.parse_error = "Extraneous token after language construct";
+        } else {
+            switch (token.type) {
+                case (urcl::token::uir): {
+                    if (token.original == "[") {
+                        inUir = true;
+                        uirOperand = 0;
+                    } else {
+                        inUir = false;
+                        if (uirOperand != 2) {
+                            token.parse_error = "UIR value must contain exactly one token";
                         }
-                        break;
                     }
-                    case (urcl::token::symbol): {
-                        if (!symbolDefs.contains(token.original)) {
-                            token.parse_error = "Undefined symbol";
-                        }
-                        break;
+                    break;
+                }
+                case (urcl::token::bracket): {
+                    if (token.original != "[") break;
+                    if (inArray) token.parse_error = "Nested array arguments not allowed";
+                    inArray = true;
+                    break;
+                }
+                case (urcl::token::label): {
+                    if (!labelDefs.contains(token.original)) {
+                        token.parse_error = "Undefined label";
+                    } else if (labelDefs.at(token.original).first != currentObjId) {
+                        token.parse_error = "Label defined outside of sub-object";
                     }
-                    case (urcl::token::constant): {
-                        std::string copy = util::strToUpper(token.original.substr(1));
-                        if (this->constants.contains(copy)) break;
-                        [[fallthrough]];
+                    break;
+                }
+                case (urcl::token::symbol): {
+                    if (!symbolDefs.contains(token.original)) {
+                        token.parse_error = "Undefined symbol";
                     }
-                    case (urcl::token::name): {
-                        if (definesDefs.contains(token.original)) break;
+                    break;
+                }
+                case (urcl::token::constant): {
+                    std::string copy = util::strToUpper(token.original.substr(1));
+                    if (this->constants->contains(copy)) break;
+                    [[fallthrough]];
+                }
+                case (urcl::token::name): {
+                    if (!definesDefs.contains(token.original)) {
                         token.parse_error = "Undefined constant value";
                         break;
                     }
-                    case (urcl::token::escape): {
-                        std::string escaped = token.original.substr(token.original.find('\\') + 1);
-                        switch (escaped[0]) {
-                            case ('\''):
-                            case ('"'):
-                            case ('\\'):
-                            case ('n'):
-                            case ('r'):
-                            case ('t'):
-                            case ('b'):
-                            case ('f'):
-                            case ('v'):
-                            case ('0'): {
-                                break;
-                            }
-                            default: {
-                                token.parse_error = "Invalid escape sequence";
-                            }
+                    const urcl::token *value;
+                    urcl::define_result resolution = resolveDefine(token, *this, value);
+                    if (resolution == urcl::define_result::recursive) {
+                        token.parse_error = "Recursive define";
+                    } else if (resolution == urcl::define_result::too_deep) {
+                        token.parse_error = "Define chain exceeds maximum depth of " + std::to_string(urcl::MAX_DEFINE_DEPTH);
+                    }
+                    break;
+                }
+                case (urcl::token::escape): {
+                    std::string escaped = token.original.substr(token.original.find('\\') + 1);
+                    switch (escaped[0]) {
+                        case ('\''):
+                        case ('"'):
+                        case ('\\'):
+                        case ('n'):
+                        case ('r'):
+                        case ('t'):
+                        case ('b'):
+                        case ('f'):
+                        case ('v'):
+                        case ('0'): {
+                            break;
+                        }
+                        default: {
+                            token.parse_error = "Invalid escape sequence";
                         }
-                        break;
                     }
-                    default:
-                        break;
+                    break;
                 }
+                default:
+                    break;
             }
         }
-        if (line.size() == 0) continue;
+    }
+    if (line.size() != 0) {
         if (operands && line[0].parse_error == "" && (operand < 0 || operands->size() > (size_t)operand) && inst != "@DEBUG") {
             line[0].parse_error = "Too few operands in language construct";
         } else if (inArray && line[line.size() - 1].parse_error == "") {
@@ -404,32 +964,57 @@ void urcl::source::updateErrors(const urcl::config& config) {
             line[line.size() - 1].parse_error = "Unclosed UIR value";
         }
     }
+
+    inUir = false;
+    for (size_t k = 0; k < line.size(); ++k) {
+        urcl::token& token = line[k];
+        if (!hadError[k] && token.parse_error != "") state.checkErrors.push_back(k);
+        if (token.type == urcl::token::uir) inUir = token.original == "[";
+        switch (token.type) {
+            case (urcl::token::constant):
+            case (urcl::token::name):
+                // a changed definition marks the line dirty, so this is where the highlighting follows it
+                token.semantic = resolveTokenType(inUir, token, *this, *this->constants);
+                [[fallthrough]];
+            case (urcl::token::label):
+            case (urcl::token::symbol):
+                state.names.push_back(token.original);
+                break;
+            default:
+                break;
+        }
+    }
+    state.dirty = false;
 }
 
 
 std::vector<unsigned int> urcl::source::getTokens() const {
+    return getTokens({{0, 0}, {static_cast<uint>(code.size()), 0}});
+}
+
+std::vector<unsigned int> urcl::source::getTokens(const lsp::Range& range) const {
+    stats::scope scope("getTokens");
+    size_t end = std::min<size_t>(range.end.line + 1, code.size());
+    size_t count = 0;
+    for (size_t i = range.start.line; i < end; ++i) {
+        count += code[i].size();
+    }
     std::vector<unsigned int> result;
+    result.reserve(count * 5);
+    // types and lengths were worked out when the tokens were lexed and their lines checked
     unsigned int prevLine = 0;
-    for (size_t i = 0; i < code.size(); ++i) {
-        const std::vector<urcl::token>& line = code[i];
+    for (size_t i = range.start.line; i < end; ++i) {
         unsigned int prevChar = 0;
         int lengthDiff = 0;
-        bool inUir = false;
-        for (const urcl::token& token : line) {
-            if (token.type == urcl::token::uir) {
-                if (token.original == "[") inUir = true;
-                else inUir = false; 
-            }
-            int tokenType = resolveTokenType(inUir, token, *this, this->constants);
-            if (tokenType < 0) continue;
-            //result.reserve(5);
+        for (const urcl::token& token : code[i]) {
+            if (token.semantic < 0) continue;
             result.push_back(i - prevLine);
             result.push_back(token.column - lengthDiff - prevChar);
-            result.push_back(util::utf8len(token.original.c_str()));
-            result.push_back(tokenType);
+            result.push_back(token.length);
+            result.push_back(token.semantic);
             result.push_back(0);
             prevChar = token.column;
-            lengthDiff = token.original.length() - util::utf8len(token.original.c_str());
+            lengthDiff = token.original.length() - token.length;
             prevLine = i;
         }
     }
@@ -467,11 +1052,11 @@ std::optional<lsp::Location> urcl::source::getDefinitionRange(const lsp::Positio
             int newToken = iFindNthOperand(code[line], 0);
             if (newToken < 0) return {};
             unsigned int newColumn = idxToColumn(code[line], newToken);
-            return {{lsp::FileUri::fromPath(file.string()), {{line, newColumn}, {line, static_cast<uint>(newColumn + util::utf8len(code[line][newToken].original.c_str()))}}}};
+            return {{lsp::FileUri::fromPath(file.string()), {{line, newColumn}, {line, static_cast<uint>(newColumn + code[line][newToken].length)}}}};
         }
         case (urcl::token::constant): {
             std::string copy = util::strToUpper(token.original.substr(1));
-            if (constants.contains(copy)) return {};
+            if (constants->contains(copy)) return {};
             [[fallthrough]];
         }
         case (urcl::token::name): {
@@ -480,14 +1065,14 @@ std::optional<lsp::Location> urcl::source::getDefinitionRange(const lsp::Positio
             std::filesystem::path newFile = definesDefs.at(token.original).first;
             const urcl::source* newSrc;
             if (includes.contains(newFile)) {
-                newSrc = &includes.at(newFile);
+                newSrc = includes.at(newFile).get();
             } else {
                 newSrc = this;
             }
             int newToken = iFindNthOperand(newSrc->code[line], 1);
             if (newToken < 0) return {};
             unsigned int newColumn = idxToColumn(newSrc->code[line], newToken);
-            return {{lsp::FileUri::fromPath(newFile.string()), {{line, newColumn}, {line, static_cast<uint>(newColumn + util::utf8len(newSrc->code[line][newToken].original.c_str()))}}}};
+            return {{lsp::FileUri::fromPath(newFile.string()), {{line, newColumn}, {line, static_cast<uint>(newColumn + newSrc->code[line][newToken].length)}}}};
         }
         case (urcl::token::symbol): {
             if (!symbolDefs.contains(token.original)) return {};
@@ -495,20 +1080,132 @@ std::optional<lsp::Location> urcl::source::getDefinitionRange(const lsp::Positio
             std::filesystem::path newFile = symbolDefs.at(token.original).first;
             const urcl::source* newSrc;
             if (includes.contains(newFile)) {
-                newSrc = &includes.at(newFile);
+                newSrc = includes.at(newFile).get();
             } else {
                 newSrc = this;
             }
             int newToken = iFindNthOperand(newSrc->code[line], 0);
             if (newToken < 0) return {};
             unsigned int newColumn = idxToColumn(newSrc->code[line], newToken);
-            return {{lsp::FileUri::fromPath(newFile.string()), {{line, newColumn}, {line, static_cast<uint>(newColumn + util::utf8len(newSrc->code[line][newToken].original.c_str()))}}}};
+            return {{lsp::FileUri::fromPath(newFile.string()), {{line, newColumn}, {line, static_cast<uint>(newColumn + newSrc->code[line][newToken].length)}}}};
         }
         default:
             return {};
     }
 }
 
+std::vector<urcl::symbol> urcl::source::getSymbols() const {
+    // only what this file defines itself, definitions from includes belong to their own file
+    std::vector<urcl::symbol> result;
+    auto add = [this, &result](urcl::line_number row) {
+        const urcl::token& token = code[row][lines[row].definition];
+        unsigned int column = idxToColumn(code[row], lines[row].definition);
+        result.push_back({token.original, token.type, {{row, column}, {row, static_cast<uint>(column + token.length)}}});
+    };
+    for (const std::pair<const std::string, std::pair<urcl::object_id, urcl::line_number>>& label : labelDefs) {
+        add(label.second.second);
+    }
+    for (const std::pair<const std::string, std::pair<std::filesystem::path, urcl::line_number>>& definition : definesDefs) {
+        if (!includes.contains(definition.second.first)) add(definition.second.second);
+    }
+    for (const std::pair<const std::string, std::pair<std::filesystem::path, urcl::line_number>>& symbol : symbolDefs) {
+        if (!includes.contains(symbol.second.first)) add(symbol.second.second);
+    }
+    std::sort(result.begin(), result.end(), [](const urcl::symbol& a, const urcl::symbol& b) {
+        return a.range.start.line < b.range.start.line;
+    });
+    return result;
+}
+
+std::vector<lsp::DocumentSymbol> urcl::source::getDocumentSymbols() const {
+    // labels, defines and symbols in line order, nested inside the sub-object they appear in
+    std::vector<urcl::symbol> symbols = getSymbols();
+    std::vector<lsp::DocumentSymbol> result;
+    std::optional<lsp::DocumentSymbol> object;
+    auto symbol = symbols.begin();
+    auto addUntil = [&symbols, &symbol, &result, &object](urcl::line_number line) {
+        for (; symbol != symbols.end() && symbol->range.start.line < line; ++symbol) {
+            lsp::DocumentSymbol entry;
+            entry.name = symbol->name;
+            entry.kind = getSymbolKind(symbol->type);
+            entry.range = symbol->range;
+            entry.selectionRange = symbol->range;
+            if (object.has_value()) {
+                if (!object->children.has_value()) object->children.emplace();
+                object->children->push_back(std::move(entry));
+            } else {
+                result.push_back(std::move(entry));
+            }
+        }
+    };
+    for (const urcl::object_delimiter& delimiter : objectDefs) {
+        addUntil(delimiter.line);
+        const urcl::token& token = code[delimiter.line][lines[delimiter.line].definition];
+        unsigned int column = idxToColumn(code[delimiter.line], lines[delimiter.line].definition);
+        lsp::Range range = {{delimiter.line, column}, {delimiter.line, static_cast<uint>(column + token.length)}};
+        if (!object.has_value() && delimiter.type == urcl::sub_object::open) {
+            object.emplace();
+            object->name = token.original;
+            object->kind = lsp::SymbolKind::Module;
+            object->range = range;
+            object->selectionRange = range;
+        } else if (object.has_value() && delimiter.type == urcl::sub_object::close) {
+            object->range.end = range.end;
+            result.push_back(std::move(*object));
+            object.reset();
+        }
+    }
+    addUntil(code.size());
+    if (object.has_value()) {
+        object->range.end = {static_cast<uint>(code.size()), 0};
+        result.push_back(std::move(*object));
+    }
+    return result;
+}
+
+lsp::SymbolKind urcl::source::getSymbolKind(urcl::token::types_t type) {
+    switch (type) {
+        case (urcl::token::label):
+            return lsp::SymbolKind::Function;
+        case (urcl::token::symbol):
+            return lsp::SymbolKind::Namespace;
+        default:
+            return lsp::SymbolKind::Constant;
+    }
+}
+
+const urcl::token *urcl::source::getToken(const lsp::Position& position) const {
+    if (position.line >= code.size()) return nullptr;
+    size_t idx = columnToIdx(code[position.line], position.character);
+    if (idx >= code[position.line].size()) return nullptr;
+    return &code[position.line][idx];
+}
+
+const std::vector<urcl::token>& urcl::source::getLineTokens(urcl::line_number row) const {
+    return code[row];
+}
+
+urcl::memory_usage urcl::source::getMemoryUsage() const {
+    std::unordered_set<const void *> counted;
+    return getMemoryUsage(counted);
+}
+
+urcl::memory_usage urcl::source::getMemoryUsage(std::unordered_set<const void *>& counted) const {
+    urcl::memory_usage result;
+    result.tokens = heapBytes(code, counted);
+    result.lines = heapBytes(lines, counted);
+    result.includes = includes.bucket_count() * sizeof(void *);
+    for (const std::pair<const std::filesystem::path, std::shared_ptr<const urcl::source>>& include : includes) {
+        result.includes += sizeof(include) + 2 * sizeof(void *) + heapBytes(include.first);
+        if (counted.insert(include.second.get()).second) result.includes += sizeof(urcl::source) + include.second->getMemoryUsage(counted).total();
+    }
+    result.definitions = heapBytes(labelDefs) + heapBytes(definesDefs) + heapBytes(symbolDefs) + heapBytes(objectDefs)
+        + heapBytes(labelLines) + heapBytes(defineLines) + heapBytes(symbolLines)
+        + heapBytes(includeDefines) + heapBytes(includeSymbols) + heapBytes(changedNames) + heapBytes(defineTargets);
+    result.dialect = heapBytes(instructions, counted) + heapBytes(macros, counted) + heapBytes(ports, counted) + heapBytes(constants, counted);
+    return result;
+}
+
 std::optional<lsp::Range> urcl::source::getTokenRange(const lsp::Position& position) const {
     unsigned int row = position.line;
     unsigned int column = position.character;
@@ -516,25 +1213,34 @@ std::optional<lsp::Range> urcl::source::getTokenRange(const lsp::Position& posit
     if (idx < 0) return {};
     const urcl::token& token = code[row][idx];
     unsigned int newColumn = idxToColumn(code[row], idx);
-    return {{{row, newColumn}, {row, static_cast<uint>(newColumn + util::utf8len(token.original.c_str()))}}};
+    return {{{row, newColumn}, {row, static_cast<uint>(newColumn + token.length)}}};
 };
 
 std::vector<lsp::FoldingRange> urcl::source::getFoldingRanges() const {
     bool inRange = false;
     unsigned int start;
     std::vector<lsp::FoldingRange> result{};
-    for (std::pair<urcl::sub_object, urcl::line_number> delimiter : objectDefs) {
-        if (!inRange && delimiter.first == urcl::sub_object::open) {
+    for (const urcl::object_delimiter& delimiter : objectDefs) {
+        if (!inRange && delimiter.type == urcl::sub_object::open) {
             inRange = true;
-            start = delimiter.second;
-        } else if (inRange && delimiter.first == urcl::sub_object::close) {
+            start = delimiter.line;
+        } else if (inRange && delimiter.type == urcl::sub_object::close) {
             inRange = false;
-            result.emplace_back(start, delimiter.second);
+            result.emplace_back(start, delimiter.line);
         }
     }
     return result;
 }
 
+urcl::object_id urcl::source::objectAt(urcl::line_number row) const {
+    // ids count the sub-objects opened so far, updateObjects stores the count with each delimiter
+    auto after = std::upper_bound(objectDefs.begin(), objectDefs.end(), row, [](urcl::line_number line, const urcl::object_delimiter& delimiter) {
+        return line < delimiter.line;
+    });
+    if (after == objectDefs.begin() || (after - 1)->type == urcl::sub_object::close) return 0;
+    return (after - 1)->id;
+}
+
 int urcl::source::iFindNthOperand(const std::vector<urcl::token>& code, unsigned int operand) {
     unsigned int counter = 0;
     for (size_t i = 0; i < code.size(); ++i) {
@@ -559,7 +1265,7 @@ size_t urcl::source::columnToIdx(const std::vector<urcl::token>& line, unsigned
     unsigned int col = line[0].column;
     size_t i;
     for (i = 0; i < line.size(); ++i) {
-        col += util::utf8len(line[i].original.c_str());
+        col += line[i].length;
         if (i < line.size() - 1) {
             col += line[i + 1].column - line[i].column - line[i].original.length(); // whitespace
         }
@@ -572,16 +1278,20 @@ size_t urcl::source::columnToIdx(const std::vector<urcl::token>& line, unsigned
 unsigned int urcl::source::idxToColumn(const std::vector<urcl::token>& line, unsigned int idx) {
     unsigned int column = line[0].column;
     for (size_t i = 0; i < idx; ++i) {
-        column += util::utf8len(line[i].original.c_str());
+        column += line[i].length;
         column += line[i + 1].column - line[i].column - line[i].original.length(); // whitespace
     }
     return column;
 }
 
 std::vector<urcl::token> urcl::source::parseLine(const std::string& line, bool& inComment, const urcl::config& config) const {
+    // once per line, the parse scope covers it in traces
+    stats::scope scope("parseLine", false);
     bool inChar = false;
     bool inStr = false;
-    std::string name;
+    // the token being built is line[nameStart, nameEnd), it is only copied out once it ends
+    size_t nameStart = 0;
+    size_t nameEnd = 0;
     bool inInst = false;
     bool inName = false;
     bool inConstruct = false;
@@ -593,13 +1303,20 @@ std::vector<urcl::token> urcl::source::parseLine(const std::string& line, bool&
     bool debugMacro = false;
     bool dw = !config.useUir;
 
+    // one token per word is close enough to avoid regrowing the vector, a trailing comment is a single token
+    size_t words = 0;
+    for (size_t i = 0; i < line.size() && !(line[i] == '/' && line[i + 1] == '/'); ++i) {
+        if (CHAR_CLASSES[static_cast<unsigned char>(line[i])] != whitespace_char && (i == 0 || CHAR_CLASSES[static_cast<unsigned char>(line[i - 1])] == whitespace_char)) ++words;
+    }
+    result.reserve(words + (line.find("//") != std::string::npos));
+
     if (inComment) {
         size_t end = line.find("*/");
         if (end == std::string::npos) {
             end = line.length() - 1;
         }
         ++end;
-        result.push_back({urcl::token::comment, line.substr(0, end + 1), "", {0}, "", "", 0});
+        addToken(result, urcl::token::comment, 0, std::string_view(line).substr(0, end + 1));
     }
     for (uint32_t i = 0; i <= line.size(); ++i) {
         if (inComment) {
@@ -612,52 +1329,58 @@ std::vector<urcl::token> urcl::source::parseLine(const std::string& line, bool&
             result.back().parse_error = "Spaces not allowed in UIR value";
         }
 
-        if ((i == line.size() || util::isWhitespace(line[i])) || (inConstruct && (line[i] == '/' || line[i] == ']' || line[i] == '%'))) {
+        // line[line.size()] is the terminating null, which classifies as other_char
+        char_class type = CHAR_CLASSES[static_cast<unsigned char>(line[i])];
+        if ((i == line.size() || type == whitespace_char) || (inConstruct && (type == slash_char || type == close_bracket_char || type == port_char))) {
             if (!inConstruct) continue;
             if (inChar || inStr) {
-                name = name + line[i];
+                nameEnd = i + 1;
                 continue;
             }
 
-            result.back().original = name;
+            urcl::token& token = result.back();
+            token.original = tokenText(line, nameStart, nameEnd);
+            std::string_view name = token.original;
             if (inInst) {
-                std::transform(name.begin(), name.end(), name.begin(), ::toupper);
+                token.strVal = token.original;
+                std::transform(token.strVal.begin(), token.strVal.end(), token.strVal.begin(), ::toupper);
+                name = token.strVal;
                 if (name == "DW" || name == "RW") dw = true;
-                result.back().strVal = name;
-                switch (result.back().type) {
+                switch (token.type) {
                     case (urcl::token::instruction): {
                         if (runHeader) {
-                            if (!urcl::defines::RUN_MODES.contains(name)) {
-                                result.back().parse_error = "Unknown RUN header value: " + name;
+                            if (!urcl::defines::RUN_MODES.contains(token.strVal)) {
+                                token.parse_error = "Unknown RUN header value: " + token.strVal;
                                 runHeader = false;
                             }
                         } else if (debugMacro) {
-                            if (!urcl::defines::DEBUG_MODES.contains(name)) {
-                                result.back().parse_error = "Unknown @DEBUG mode: " + name;
+                            if (!urcl::defines::DEBUG_MODES.contains(token.strVal)) {
+                                token.parse_error = "Unknown @DEBUG mode: " + token.strVal;
                                 debugMacro = false;
                             }
-                        } else if (!instructions.contains(name)) {
-                            result.back().parse_error = "Unknown instruction: " + name;
+                        } else if (!instructions->contains(token.strVal)) {
+                            token.parse_error = "Unknown instruction: " + token.strVal;
                         }
                         break;
                     }
                     case (urcl::token::macro): {
                         if (!config.useStandard && !config.useUrcx && !config.useIris) break;
-                        if (!macros.contains(name)) {
-                            result.back().parse_error = "Unknown macro: " + name;
+                        if (!macros->contains(token.strVal)) {
+                            token.parse_error = "Unknown macro: " + token.strVal;
                         }
                         break;
                     }
                     case (urcl::token::port): {
                         if (!config.useStandard && !config.useUrcx && !config.useIris) break;
-                        name.erase(0, 1);
+                        name.remove_prefix(1);
+                        int portNumb;
                         if (util::isNumber(name)) {
-                            int portNumb = std::stoi(name);
-                            if (portNumb > 63 || portNumb < 0) {
-                                result.back().parse_error = "Invalid port number: " + name;
+                            // too many digits to be a port fails like a number out of range
+                            if (std::from_chars(name.data(), name.data() + name.length(), portNumb).ec != std::errc() || portNumb > 63 || portNumb < 0) {
+                                token.parse_error = "Invalid port number: " + std::string(name);
                             }
-                        } else if (!ports.contains(name)) {
-                            result.back().parse_error = "Unknown port: " + name;
+                        } else if (!ports->contains(std::string(name))) {
+                            token.parse_error = "Unknown port: " + std::string(name);
                         }
                         break;
                     }
@@ -675,26 +1398,27 @@ std::vector<urcl::token> urcl::source::parseLine(const std::string& line, bool&
                 inInst = false;
             } else if (inName) {
                 if ((config.useIris || config.useUrcx) && name == "_") {
-                    result.back().type = urcl::token::literal;
-                    result.back().value.literal = 0;
+                    token.type = urcl::token::literal;
+                    token.value.literal = 0;
                 }
                 inName = false;
             } else {
-                switch (result.back().type) {
+                switch (token.type) {
                     case (urcl::token::relative): {
-                        if (name[1] != '+' && name[1] != '-') {
+                        char sign = name.length() > 1 ? name[1] : '\0';
+                        if (sign != '+' && sign != '-') {
                             if (config.useStandard || !config.useUrcx) {
-                                result.back().parse_error = "Relative without sign";
+                                token.parse_error = "Relative without sign";
                             }
-                            name.erase(0, 1);
+                            name.remove_prefix(1);
                         } else {
-                            name.erase(0, 2);
+                            name.remove_prefix(2);
                         }
                         if (inUir) {
-                            result.back().parse_error = "Relatives not allowed in UIR values";
+                            token.parse_error = "Relatives not allowed in UIR values";
                         }
                         if (!util::isNumber(name)) {
-                            result.back().parse_error = "Invalid integer in relative";
+                            token.parse_error = "Invalid integer in relative";
                         }
                         break;
                     }
@@ -703,25 +1427,31 @@ std::vector<urcl::token> urcl::source::parseLine(const std::string& line, bool&
                         int sign = 1;
                         if (name[0] == '-') {
                             sign = -1;
-                            name.erase(0, 1);
+                            name.remove_prefix(1);
                         } else if (name[0] == '+') {
-                            name.erase(0, 1);
+                            name.remove_prefix(1);
                         }
 
                         if (name.length() > 2 && name[0] == '0') {
                             if (name[1] == 'b') {
                                 base = 2;
-                                name.erase(0, 2);
+                                name.remove_prefix(2);
                             } else if (name[1] == 'o') {
                                 base = 8;
-                                name.erase(0, 2);
+                                name.remove_prefix(2);
                             } else if (name[1] == 'x') {
                                 base = 16;
-                                name.erase(0, 2);
+                                name.remove_prefix(2);
                             }
                         }
 
-                        std::erase(name, '_');
+                        // digit separators are the only case that needs a copy
+                        std::string digits;
+                        if (name.find('_') != std::string_view::npos) {
+                            digits = name;
+                            std::erase(digits, '_');
+                            name = digits;
+                        }
 
                         bool valid;
                         if (base == 2) {
@@ -731,50 +1461,50 @@ std::vector<urcl::token> urcl::source::parseLine(const std::string& line, bool&
                         } else if (base == 16) {
                             valid = util::isHex(name);
                         } else {
-                            if (name.find('.') == std::string::npos) {
+                            if (name.find('.') == std::string_view::npos) {
                                 valid = util::isNumber(name);
                             } else {
-                                
-                                valid = util::isFloat(name);
+                                long double value;
+                                // isFloat lets a sign through when there is no exponent, from_chars only takes '-'
+                                std::string_view number = name.starts_with('+') ? name.substr(1) : name;
+                                valid = util::isFloat(name) && parseReal(number, value);
                                 if (valid) {
-                                    long double value = std::stold(name);
-                                    result.back().value.real = value * sign;
-                                    result.back().type = urcl::token::real;
+                                    token.value.real = value * sign;
+                                    token.type = urcl::token::real;
                                     if (config.useStandard && !config.useIris) {
-                                        result.back().parse_error = "Floats are non-standard";
+                                        token.parse_error = "Floats are non-standard";
                                     }
                                 } else {
-                                    result.back().parse_error = "Invalid float literal";
-                                    result.back().value.real = 0;
-                                    result.back().type = urcl::token::name;
+                                    token.parse_error = "Invalid float literal";
+                                    token.value.real = 0;
+                                    token.type = urcl::token::name;
                                 }
                                 break;
                             }
                         }
                         if (valid) {
                             int64_t value;
-                            try {
-                                value = std::stoll(name, nullptr, base);
-                            } catch (std::exception&) {
+                            // out of range values become 0
+                            if (std::from_chars(name.data(), name.data() + name.length(), value, base).ec != std::errc()) {
                                 value = 0;
                             }
-                            result.back().value.literal = value * sign;
+                            token.value.literal = value * sign;
                         } else {
-                            result.back().parse_error = "Invalid integer literal";
-                            result.back().value.literal = 0;
-                            result.back().type = urcl::token::name;
+                            token.parse_error = "Invalid integer literal";
+                            token.value.literal = 0;
+                            token.type = urcl::token::name;
                         }
                         break;
                     }
                     case (urcl::token::mem):
                     case (urcl::token::reg): {
-                        if (result.back().type == urcl::token::reg && !config.useRegs) {
-                            result.back().parse_error = "Registers not allowed";
+                        if (token.type == urcl::token::reg && !config.useRegs) {
+                            token.parse_error = "Registers not allowed";
                             break;
                         }
                         if (!util::isNumber(name.substr(1))) {
-                            result.back().parse_error = result.back().type == urcl::token::reg ? "Invalid integer in register" : "Invalid integer in memory address";
-                            result.back().type = urcl::token::name;
+                            token.parse_error = token.type == urcl::token::reg ? "Invalid integer in register" : "Invalid integer in memory address";
+                            token.type = urcl::token::name;
                         }
                         break;
                     }
@@ -784,47 +1514,47 @@ std::vector<urcl::token> urcl::source::parseLine(const std::string& line, bool&
                 }
             }
             inConstruct = false;
-            if (!(i < line.length() && (line[i] == '/' || line[i] == ']' || line[i] == '%'))) continue;
+            if (!(i < line.length() && (type == slash_char || type == close_bracket_char || type == port_char))) continue;
         }
 
         if (inStr && line[i] == '\\') {
-            result.back().original = name;
-            result.push_back({urcl::token::escape, line.substr(i, 2), "", {0}, "", "", i});
+            result.back().original = tokenText(line, nameStart, nameEnd);
+            addToken(result, urcl::token::escape, i, std::string_view(line).substr(i, 2));
             ++i;
-            result.push_back({urcl::token::string, "", "", {0}, "", "", i + 1});
-            name = "";
+            addToken(result, urcl::token::string, i + 1);
+            nameStart = i + 1;
+            nameEnd = nameStart;
             continue;
         }
 
         if (inChar && line[i] == '\\') {
-            name = name + line[i] + line[i + 1];
+            nameEnd = i + 2;
             result.back().type = urcl::token::escape;
             ++i;
             continue;
         }
 
         if ((inStr && line[i] == '"') || (inChar && line[i] == '\'')) {
-            name = name + line[i];
-            result.back().original = name;
+            nameEnd = i + 1;
+            result.back().original = tokenText(line, nameStart, nameEnd);
             inStr = false;
             inChar = false;
             inConstruct = false;
             continue;
         }
 
-        const urcl::token& current = result.back();
-        if (inConstruct && !std::isdigit(line[i]) && (current.type == token::reg || current.type == token::mem)) {
+        if (inConstruct && type != digit_char && (result.back().type == token::reg || result.back().type == token::mem)) {
             result.back().type = urcl::token::name;
             inName = true;
         }
 
         if (inConstruct) {
-            name = name + line[i];
+            nameEnd = i + 1;
             continue;
         }
 
         if (line[i] == '/' && line[i + 1] == '/') {
-            result.push_back({urcl::token::comment, line.substr(i), "", {0}, "", "", i});
+            addToken(result, urcl::token::comment, i, std::string_view(line).substr(i));
             break;
         }
 
@@ -834,21 +1564,21 @@ std::vector<urcl::token> urcl::source::parseLine(const std::string& line, bool&
                 end = line.length() - 1;
             }
             ++end;
-            result.push_back({urcl::token::comment, line.substr(i, end - i + 1), "", {0}, "", "", i});
+            addToken(result, urcl::token::comment, i, std::string_view(line).substr(i, end - i + 1));
             inComment = true;
             ++i;
             continue;
         }
 
-        if (line[i] == '.') {
-            result.push_back({urcl::token::label, "", "", {0}, "", "", i});
-            name = line[i];
+        nameStart = i;
+        nameEnd = i + 1;
+        if (type == label_char) {
+            addToken(result, urcl::token::label, i);
             inConstruct = true;
             otherToken = true;
             continue;
-        } else if (line[i] == '!') {
-            result.push_back({urcl::token::symbol, "", "", {0}, "", "", i});
-            name = line[i];
+        } else if (type == symbol_char) {
+            addToken(result, urcl::token::symbol, i);
             inConstruct = true;
             otherToken = true;
             continue;
@@ -856,11 +1586,10 @@ std::vector<urcl::token> urcl::source::parseLine(const std::string& line, bool&
 
         if (!otherToken) {
             if (line[i] == '@') {
-                result.push_back({urcl::token::macro, "", "", {0}, "", "", i});
+                addToken(result, urcl::token::macro, i);
             } else {
-                result.push_back({urcl::token::instruction, "", "", {0}, "", "", i});
+                addToken(result, urcl::token::instruction, i);
             }
-            name = line[i];
             inConstruct = true;
             inInst = true;
             otherToken = true;
@@ -871,146 +1600,142 @@ std::vector<urcl::token> urcl::source::parseLine(const std::string& line, bool&
 
         inConstruct = true;
 
-        name = line[i];
-        if (line[i] == 'R' || line[i] == 'r' || line[i] == '$') {
-            result.push_back({urcl::token::reg, "", "", {0}, "", "", i});
-        } else if ((line[i] == 'S' || line[i] == 's') && (line[i + 1] == 'P' || line[i + 1] == 'p')) {
-            result.push_back({urcl::token::reg, line.substr(i, 2), "", {-1}, "", "", i});
-            inConstruct = false;
-            ++i;
-        } else if ((line[i] == 'P' || line[i] == 'p') && (line[i + 1] == 'C' || line[i + 1] == 'c')) {
-            result.push_back({urcl::token::reg, line.substr(i, 2), "", {-2}, "", "", i});
-            inConstruct = false;
-            ++i;
-        } else if (line[i] == 'M' || line[i] == 'm' || line[i] == '#') {
-            result.push_back({urcl::token::mem, "", "", {0}, "", "", i});
-        } else if (std::isdigit(line[i]) || line[i] == '+' || line[i] == '-') {
-            result.push_back({urcl::token::literal, "", "", {0}, "", "", i});
-        } else if (line[i] == '%') {
-            result.push_back({urcl::token::port, "", "", {0}, "", "", i});
-            inInst = true;
-        } else if (line[i] == '~') {
-            result.push_back({urcl::token::relative, "", "", {0}, "", "", i});
-        } else if (config.useUir && !dw && line[i] == '[') {
-            result.push_back({urcl::token::uir, line.substr(i, 1), "", {0}, "", "", i});
-            inConstruct = false;
-            if (inUir) result.back().parse_error = "Nested UIR values are not allowed";
-            inUir = true;
-        } else if (config.useUir && !dw && line[i] == ']') {
-            result.push_back({urcl::token::uir, line.substr(i, 1), "", {0}, "", "", i});
-            inConstruct = false;
-            if (!inUir) result.back().parse_error = "UIR value closed before it was opened";
-            inUir = false;
-        } else if (line[i] == '[' || line[i] == ']') {
-            result.push_back({urcl::token::bracket, line.substr(i, 1), "", {0}, "", "", i});
-            inConstruct = false;
-        } else if (line[i] == '@') {
-            result.push_back({urcl::token::constant, "", "", {0}, "", "", i});
-        } else if (line[i] == '"') {
-            result.push_back({urcl::token::string, "", "", {0}, "", "", i});
-            inStr = true;
-        } else if (line[i] == '\'') {
-            result.push_back({urcl::token::character, "", "", {0}, "", "", i});
-            inChar = true;
-        } else if ((line[i] == '>' || line[i] == '<' || line[i] == '=') && line[i + 1] == '=') {
-            result.push_back({urcl::token::comparison, line.substr(i, 2), "", {0}, "", "", i});
-            inConstruct = false;
-            ++i;
-        } else {
-            result.push_back({urcl::token::name, "", "", {0}, "", "", i});
-            inName = true;
+        // the first character decides the kind of operand, a few need the one after it too
+        char next = line[i + 1];
+        switch (type) {
+            case (register_char):
+                addToken(result, urcl::token::reg, i);
+                break;
+            case (memory_char):
+                addToken(result, urcl::token::mem, i);
+                break;
+            case (digit_char):
+            case (sign_char):
+                addToken(result, urcl::token::literal, i);
+                break;
+            case (port_char):
+                addToken(result, urcl::token::port, i);
+                inInst = true;
+                break;
+            case (relative_char):
+                addToken(result, urcl::token::relative, i);
+                break;
+            case (open_bracket_char):
+            case (close_bracket_char): {
+                bool open = type == open_bracket_char;
+                inConstruct = false;
+                if (!config.useUir || dw) {
+                    addToken(result, urcl::token::bracket, i, std::string_view(line).substr(i, 1));
+                    break;
+                }
+                addToken(result, urcl::token::uir, i, std::string_view(line).substr(i, 1));
+                if (open && inUir) result.back().parse_error = "Nested UIR values are not allowed";
+                if (!open && !inUir) result.back().parse_error = "UIR value closed before it was opened";
+                inUir = open;
+                break;
+            }
+            case (constant_char):
+                addToken(result, urcl::token::constant, i);
+                break;
+            case (quote_char):
+                addToken(result, urcl::token::string, i);
+                inStr = true;
+                break;
+            case (apostrophe_char):
+                addToken(result, urcl::token::character, i);
+                inChar = true;
+                break;
+            case (stack_char):
+            case (counter_char):
+            case (comparison_char): {
+                // SP, PC and two character comparisons are complete tokens
+                bool pair = type == stack_char ? (next == 'P' || next == 'p') : type == counter_char ? (next == 'C' || next == 'c') : next == '=';
+                if (!pair) {
+                    addToken(result, urcl::token::name, i);
+                    inName = true;
+                    break;
+                }
+                if (type == comparison_char) {
+                    addToken(result, urcl::token::comparison, i, std::string_view(line).substr(i, 2));
+                } else {
+                    addToken(result, urcl::token::reg, i, std::string_view(line).substr(i, 2)).value.real = type == stack_char ? -1 : -2;
+                }
+                inConstruct = false;
+                ++i;
+                break;
+            }
+            default:
+                addToken(result, urcl::token::name, i);
+                inName = true;
+                break;
         }
     }
     if (inStr) {
-        result.back().original = name;
+        result.back().original = tokenText(line, nameStart, nameEnd);
         result.back().parse_error = "Unterminated string";
     }
     if (inChar) {
-        result.back().original = name;
+        result.back().original = tokenText(line, nameStart, nameEnd);
         result.back().parse_error = "Unterminated character";
     }
+    // defines and constants are highlighted once checkLine has resolved them
+    bool uir = false;
+    for (urcl::token& token : result) {
+        token.length = util::utf8len(token.original);
+        if (token.type == urcl::token::uir) uir = token.original == "[";
+        token.semantic = lexedTokenType(uir, token);
+    }
     return result;
 }
 
 int urcl::source::resolveTokenType(bool inUir, const urcl::token& token, const urcl::source& original, const std::unordered_set<std::string>& constants) const {
-    int tokenType = 0;
+    if (inUir || (token.type != urcl::token::constant && token.type != urcl::token::name)) return lexedTokenType(inUir, token);
+    if (token.type == urcl::token::constant && constants.contains(util::strToUpper(token.original.substr(1)))) return 7;
+    const urcl::token *value;
+    if (resolveDefine(token, original, value) != urcl::define_result::resolved) return -1;
+    int tokenType = resolveTokenType(false, *value, original, constants);
+    if (tokenType == 9) tokenType = 8;
+    return tokenType;
+}
+
+// the type a token is highlighted as without looking at any definitions, -1 for the ones that need them
+int urcl::source::lexedTokenType(bool inUir, const urcl::token& token) {
     if (inUir) return 1;
     switch (token.type) {
         case (urcl::token::instruction):
-            tokenType = 0;
-            break;
+            return 0;
         case (urcl::token::uir):
         case (urcl::token::reg):
-            tokenType = 1;
-            break;
+            return 1;
         case (urcl::token::relative):
         case (urcl::token::literal):
         case (urcl::token::real):
-            tokenType = 2;
-            break;
+            return 2;
         case (urcl::token::label):
-            tokenType = 3;
-            break;
+            return 3;
         case (urcl::token::comment):
-            tokenType = 4;
-            break;
+            return 4;
         case (urcl::token::port):
         case (urcl::token::mem):
-            tokenType = 5;
-            break;
+            return 5;
         case (urcl::token::macro):
-            tokenType = 7;
-            break;
+            return 7;
         case (urcl::token::character):
         case (urcl::token::string):
-            tokenType = 8;
-            break;
+            return 8;
         case (urcl::token::escape):
-            tokenType = 9;
-            break;
+            return 9;
         case (urcl::token::comparison):
         case (urcl::token::bracket):
-            tokenType = 10;
-            break;
+            return 10;
         case (urcl::token::symbol):
-            if (token.original.length() >= 2 && token.original.substr(0, 2) == "!!") {
-                tokenType = 11;
-            } else {
-                tokenType = 3;
-            }
-            break;
-        case (urcl::token::constant): {
-            std::string copy = util::strToUpper(token.original.substr(1));
-            if (constants.contains(copy)) {
-                tokenType = 7;
-                break;
-            }
-            [[fallthrough]];
-        }
-        case (urcl::token::name): {
-            if (original.definesDefs.contains(token.original)) {
-                const std::filesystem::path& newPath = original.definesDefs.at(token.original).first;
-                const urcl::source *newSrc;
-                if (original.includes.contains(newPath)) {
-                    newSrc = &original.includes.at(newPath);
-                } else {
-                    newSrc = &original;
-                }
-                const urcl::token *newToken = urcl::source::findNthOperand(newSrc->code[original.definesDefs.at(token.original).second], 2);
-                if (newToken == nullptr) {
-                    tokenType = -1;
-                    return tokenType;
-                }
-                tokenType = newSrc->resolveTokenType(false, *newToken, original, constants);
-                if (tokenType == 9) tokenType = 8;
-                break;
-            } else {
-                tokenType = -1;
-            }
-            break;
-        }
+            if (token.original.length() >= 2 && token.original.substr(0, 2) == "!!") return 11;
+            return 3;
+        case (urcl::token::constant):
+        case (urcl::token::name):
+            return -1;
     }
-    return tokenType;
+    return 0;
 }
 
 std::vector<lsp::CompletionItem> urcl::source::getCompletion(const lsp::Position& position, const urcl::config& config) const {
@@ -1073,7 +1798,7 @@ std::vector<lsp::CompletionItem> urcl::source::getCompletion(const lsp::Position
         case (urcl::token::name):
         case (urcl::token::constant): {
             if (token.original[0] == '@') {
-                for (const std::string& constant : constants) {
+                for (const std::string& constant : *constants) {
                     if (constant.starts_with(token.original.substr(1))) {
                         if (config.useLowercase) {
                             result.emplace_back(util::strToLower(constant));
@@ -1110,7 +1835,7 @@ std::vector<lsp::CompletionItem> urcl::source::getCompletion(const lsp::Position
                 }
                 break;
             }
-            for (const std::string& inst : instructions) {
+            for (const std::string& inst : *instructions) {
                 if (inst.starts_with(token.strVal)) {
                     if (config.useLowercase) {
                         result.emplace_back(util::strToLower(inst));
@@ -1122,7 +1847,7 @@ std::vector<lsp::CompletionItem> urcl::source::getCompletion(const lsp::Position
             break;
         }
         case (urcl::token::macro): {
-            for (const std::string& macro : macros) {
+            for (const std::string& macro : *macros) {
                 if (macro.starts_with(token.strVal)) {
                     if (config.useLowercase) {
                         result.emplace_back(util::strToLower(macro.substr(1)));
@@ -1134,7 +1859,7 @@ std::vector<lsp::CompletionItem> urcl::source::getCompletion(const lsp::Position
             break;
         }
         case (urcl::token::port): {
-            for (const std::string& port : ports) {
+            for (const std::string& port : *ports) {
                 if (port.starts_with(token.strVal.substr(1))) {
                     if (config.useLowercase) {
                         result.emplace_back(util::strToLower(port));
@@ -1265,28 +1990,16 @@ std::optional<std::string> urcl::source::getHover(const urcl::token& token, cons
         }
         case (urcl::token::constant): {
             std::string copy = util::strToUpper(token.original.substr(1));
-            if (constants.contains(copy)) {
+            if (constants->contains(copy)) {
                 if (inConst) return token.original;
                 break;
             }
             [[fallthrough]];
         }
         case (urcl::token::name): {
-            if (definesDefs.contains(token.original)) {
-                const std::filesystem::path& newPath = definesDefs.at(token.original).first;
-                const urcl::source *newSrc;
-                if (includes.contains(newPath)) {
-                    newSrc = &includes.at(newPath);
-                } else {
-                    newSrc = this;
-                }
-                const urcl::token *newToken = urcl::source::findNthOperand(newSrc->code[definesDefs.at(token.original).second], 2);
-                if (newToken == nullptr) {
-                    break;
-                }
-                return getHover(*newToken, config, true);
-            }
-            break;
+            const urcl::token *value;
+            if (resolveDefine(token, *this, value) != urcl::define_result::resolved) break;
+            return getHover(*value, config, true);
         }
         default: {
             break;
@@ -1297,19 +2010,28 @@ std::optional<std::string> urcl::source::getHover(const urcl::token& token, cons
 
 std::vector<lsp::Location> urcl::source::getReferences(const lsp::Position& position, const lsp::DocumentUri& uri) const {
     std::vector<lsp::Location> result;
+    getReferences(position, uri, [&result](std::vector<lsp::Location>&& batch) {
+        result.insert(result.end(), std::make_move_iterator(batch.begin()), std::make_move_iterator(batch.end()));
+        return true;
+    });
+    return result;
+}
+
+bool urcl::source::getReferences(const lsp::Position& position, const lsp::DocumentUri& uri, const std::function<bool(std::vector<lsp::Location>&&)>& report) const {
     unsigned int row = position.line;
     unsigned int column = position.character;
     int idx = columnToIdx(code[row], column);
-    if (idx < 0) return result;
+    if (idx < 0) return true;
     const urcl::token& token = code[row][idx];
     if (token.type == urcl::token::constant) {
         std::string copy = util::strToUpper(token.original.substr(1));
-        if (constants.contains(copy)) return result;
+        if (constants->contains(copy)) return true;
     } else if (token.type != urcl::token::label && token.type != urcl::token::symbol && token.type != urcl::token::name) {
-        return result;
+        return true;
     }
     
-    unsigned int length = util::utf8len(token.original.c_str());
+    unsigned int length = token.length;
+    std::vector<lsp::Location> result;
     for (unsigned int j = 0; j < code.size(); ++j) {
         if (j == position.line) continue;
         const std::vector<urcl::token>& line = code[j];
@@ -1323,11 +2045,13 @@ std::vector<lsp::Location> urcl::source::getReferences(const lsp::Position& posi
             }
         }
     }
-    if (token.type == urcl::token::label) return result;
+    if (!report(std::move(result))) return false;
+    if (token.type == urcl::token::label) return true;
 
-    for (const std::pair<const std::filesystem::path, urcl::source>& include : includes) {
+    for (const std::pair<const std::filesystem::path, std::shared_ptr<const urcl::source>>& include : includes) {
         lsp::DocumentUri newUri = lsp::FileUri::fromPath(include.first.string());
-        const urcl::source& included = include.second;
+        const urcl::source& included = *include.second;
+        std::vector<lsp::Location> found;
         for (unsigned int j = 0; j < included.code.size(); ++j) {
             const std::vector<urcl::token>& line = included.code[j];
             for (unsigned int i = 0; i < line.size(); ++i) {
@@ -1335,43 +2059,74 @@ std::vector<lsp::Location> urcl::source::getReferences(const lsp::Position& posi
                 if (token.type == token2.type && token.original == token2.original) {
                     unsigned int column = idxToColumn(line, i);
                     lsp::Location loc = lsp::Location{newUri, {{j, column}, {j, (column + length)}}};
-                    result.push_back(std::move(loc));
+                    found.push_back(std::move(loc));
                 }
             }
         }
+        if (!report(std::move(found))) return false;
     }
 
-    return result;
+    return true;
 }
 
 const urcl::token *urcl::source::getBaseToken(const urcl::token& token, const urcl::source& original) const {
-    switch (token.type) {
-        case (urcl::token::constant): {
-            std::string copy = util::strToUpper(token.original.substr(1));
-            if (constants.contains(copy)) return &token;
-            [[fallthrough]];
+    const urcl::token *result;
+    if (resolveDefine(token, original, result) != urcl::define_result::resolved) return nullptr;
+    return result;
+}
+
+urcl::define_result urcl::source::resolveDefine(const urcl::token& token, const urcl::source& original, const urcl::token *&result) const {
+    auto isLink = [&original](const urcl::token& link) {
+        if (link.type == urcl::token::constant) {
+            return !original.constants->contains(util::strToUpper(link.original.substr(1)));
         }
-        case (urcl::token::name): {
-            if (original.definesDefs.contains(token.original)) {
-                const std::filesystem::path& newPath = original.definesDefs.at(token.original).first;
-                const urcl::source *newSrc;
-                if (original.includes.contains(newPath)) {
-                    newSrc = &original.includes.at(newPath);
-                } else {
-                    newSrc = &original;
-                }
-                const urcl::token *newToken = urcl::source::findNthOperand(newSrc->code[original.definesDefs.at(token.original).second], 2);
-                if (newToken == nullptr) {
-                    return nullptr;
-                }
-                return newSrc->getBaseToken(*newToken, original);
+        return link.type == urcl::token::name;
+    };
+
+    if (!isLink(token)) {
+        result = &token;
+        return urcl::define_result::resolved;
+    }
+    if (original.definesResolved && original.changedNames.empty()) {
+        auto target = original.defineTargets.find(token.original);
+        if (target == original.defineTargets.end()) return urcl::define_result::undefined;
+        if (target->second.depth > urcl::MAX_DEFINE_DEPTH) return urcl::define_result::too_deep;
+        if (target->second.result != urcl::define_result::resolved) return target->second.result;
+        urcl::token last{urcl::token::name, target->second.last, "", {0}, "", "", 0};
+        result = getDefineValue(last, original);
+        return urcl::define_result::resolved;
+    }
+
+    // a chain with more links than there are defines has to revisit one, so cycles are found without a visited set
+    const size_t limit = std::min<size_t>(original.definesDefs.size(), urcl::MAX_DEFINE_DEPTH);
+    const urcl::token *current = &token;
+    for (size_t depth = 0; isLink(*current); ++depth) {
+        if (!original.definesDefs.contains(current->original)) return urcl::define_result::undefined;
+        if (depth == limit) {
+            if (limit == original.definesDefs.size()) return urcl::define_result::recursive;
+            // the depth cap was reached first, walk the chain again to tell a cycle from a long chain
+            std::unordered_set<std::string_view> visited;
+            for (current = &token; visited.size() <= urcl::MAX_DEFINE_DEPTH; current = getDefineValue(*current, original)) {
+                if (!visited.insert(current->original).second) return urcl::define_result::recursive;
             }
-            return nullptr;
-        }
-        default: {
-            return &token;
+            return urcl::define_result::too_deep;
         }
+        current = getDefineValue(*current, original);
+        if (current == nullptr) return urcl::define_result::undefined;
+    }
+    result = current;
+    return urcl::define_result::resolved;
+}
+
+const urcl::token *urcl::source::getDefineValue(const urcl::token& token, const urcl::source& original) {
+    const std::pair<std::filesystem::path, urcl::line_number>& definition = original.definesDefs.at(token.original);
+    const urcl::source *newSrc;
+    if (original.includes.contains(definition.first)) {
+        newSrc = original.includes.at(definition.first).get();
+    } else {
+        newSrc = &original;
     }
+    return urcl::source::findNthOperand(newSrc->code[definition.second], 2);
 }
 
 bool urcl::source::tokenIsRegister(const urcl::token& token, const urcl::source& original) const {
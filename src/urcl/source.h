@@ -2,33 +2,113 @@
 #define SOURCE_H
 
 #include "config.h"
+#include "shared_vector.h"
 #include "token.h"
 
 #include <vector>
 #include <map>
+#include <memory>
+#include <optional>
 #include <unordered_set>
 #include <filesystem>
+#include <functional>
 #include <lsp/types.h>
 
 namespace urcl {
     using line_number = unsigned int;
     using object_id = unsigned int;
 
+    // longest @DEFINE chain followed before giving up on resolving a value
+    constexpr unsigned int MAX_DEFINE_DEPTH = 256;
+
     enum sub_object {
         open,
         close
     };
 
+    enum define_result {
+        resolved,
+        undefined,
+        recursive,
+        too_deep
+    };
+
+    // a line opening or closing a sub-object
+    struct object_delimiter {
+        urcl::sub_object type;
+        urcl::line_number line;
+        urcl::object_id id = 0; // sub-objects opened up to and including this one, set by updateObjects
+    };
+
+    // where the chain of a define ends, worked out once per change of the definitions
+    struct define_target {
+        urcl::define_result result = urcl::define_result::resolved;
+        unsigned int depth = 0; // links followed, or names visited for a recursive chain
+        std::string last; // last link of a resolved chain, its value is what the define resolves to
+    };
+
+    enum definition_kind {
+        no_definition,
+        label_definition,
+        define_definition,
+        symbol_definition,
+        object_definition
+    };
+
+    struct line_state {
+        bool inComment = false; // lexer state at the end of the line
+        bool dirty = true; // operands have to be checked again
+        bool scanned = false; // definitions of the line have been recorded
+        urcl::definition_kind definitionKind = urcl::no_definition;
+        uint32_t definition = 0; // token holding the defined name
+        uint16_t bits = 0; // width requested by a BITS header
+        std::vector<std::string> names; // labels, symbols and defines used by the line
+        std::vector<std::pair<uint32_t, std::string>> definitionErrors; // token index and the error it replaced
+        std::vector<uint32_t> checkErrors;
+    };
+
+    // a label, define or symbol defined by a file
+    struct symbol {
+        std::string name;
+        urcl::token::types_t type;
+        lsp::Range range;
+    };
+
+    // estimated heap bytes held by a source, split by the structure holding them
+    struct memory_usage {
+        size_t tokens = 0; // lexed lines
+        size_t lines = 0; // per-line analysis state
+        size_t includes = 0; // included files
+        size_t definitions = 0; // definition maps and definition lines
+        size_t dialect = 0; // instruction, macro, port and constant sets
+
+        size_t total() const {
+            return tokens + lines + includes + definitions + dialect;
+        }
+
+        urcl::memory_usage& operator+=(const urcl::memory_usage& other) {
+            tokens += other.tokens;
+            lines += other.lines;
+            includes += other.includes;
+            definitions += other.definitions;
+            dialect += other.dialect;
+            return *this;
+        }
+    };
+
     class source {
         public:
             source();
             source(const std::vector<std::string>& source, const urcl::config& config);
 
-            void updateReferences(const std::unordered_map<std::filesystem::path, source>& all, const urcl::config& config);
+            void update(const std::vector<std::string>& document, urcl::line_number start, urcl::line_number end, urcl::line_number count, const urcl::config& config);
+            // loaded is called once per include with the bytes read from disk, 0 for the open ones
+            void updateReferences(const std::unordered_map<std::filesystem::path, std::shared_ptr<const source>>& all, const urcl::config& config, const std::function<void(size_t)>& loaded = {});
             void updateDefinitions(const std::filesystem::path& loc, const urcl::config& config);
             void updateErrors(const urcl::config& config);
 
             std::vector<unsigned int> getTokens() const;
+            std::vector<unsigned int> getTokens(const lsp::Range& range) const;
             std::vector<lsp::Diagnostic> getDiagnostics() const;
             std::optional<lsp::Location> getDefinitionRange(const lsp::Position& position, const std::filesystem::path& file) const;
             std::optional<lsp::Range> getTokenRange(const lsp::Position& position) const;
@@ -36,22 +116,50 @@ namespace urcl {
             std::vector<lsp::CompletionItem> getCompletion(const lsp::Position& position, const urcl::config& config) const;
             std::optional<std::string> getHover(const lsp::Position& position, const urcl::config& config) const;
             std::vector<lsp::Location> getReferences(const lsp::Position& position, const lsp::DocumentUri& uri) const;
+            // hands over the references one file at a time, stops when report returns false
+            bool getReferences(const lsp::Position& position, const lsp::DocumentUri& uri, const std::function<bool(std::vector<lsp::Location>&&)>& report) const;
+            std::vector<urcl::symbol> getSymbols() const;
+            std::vector<lsp::DocumentSymbol> getDocumentSymbols() const;
+            const urcl::token *getToken(const lsp::Position& position) const;
+            const std::vector<urcl::token>& getLineTokens(urcl::line_number row) const;
+            urcl::memory_usage getMemoryUsage() const;
+            // skips lines, includes and sets already in counted, which are shared with copies of the source
+            urcl::memory_usage getMemoryUsage(std::unordered_set<const void *>& counted) const;
+
+            static lsp::SymbolKind getSymbolKind(urcl::token::types_t type);
         private:
             std::optional<std::string> getHover(const urcl::token& token, const urcl::config& config, bool inConst) const;
-            std::vector<std::vector<token>> code;
+            // lines are shared with copies of the source, such as published snapshots, until they are edited
+            urcl::shared_vector<std::vector<token>> code;
+            urcl::shared_vector<urcl::line_state> lines;
             std::unordered_map<std::string, std::pair<urcl::object_id, urcl::line_number>> labelDefs;
             std::unordered_map<std::string, std::pair<std::filesystem::path, urcl::line_number>> definesDefs;
             std::unordered_map<std::string, std::pair<std::filesystem::path, urcl::line_number>> symbolDefs;
-            std::vector<std::pair<urcl::sub_object, urcl::line_number>> objectDefs;
-            std::unordered_map<std::filesystem::path, source> includes;
-            std::unordered_set<std::string> constants;
+            std::vector<urcl::object_delimiter> objectDefs;
+            // every line of this file defining a name, in order
+            std::unordered_map<std::string, std::vector<urcl::line_number>> labelLines;
+            std::unordered_map<std::string, std::vector<urcl::line_number>> defineLines;
+            std::unordered_map<std::string, std::vector<urcl::line_number>> symbolLines;
+            std::unordered_map<std::string, std::pair<std::filesystem::path, urcl::line_number>> includeDefines;
+            std::unordered_map<std::string, std::pair<std::filesystem::path, urcl::line_number>> includeSymbols;
+            // names whose definitions have to be resolved again by updateDefinitions
+            std::unordered_set<std::string> changedNames;
+            bool objectsChanged = false;
+            // resolved chain of every define, only trusted while no definitions are waiting in changedNames
+            std::unordered_map<std::string, urcl::define_target> defineTargets;
+            bool definesResolved = false;
+            uint16_t includeBits = 0;
+            std::unordered_map<std::filesystem::path, std::shared_ptr<const source>> includes;
+            // never changed once built, so copies share them
+            std::shared_ptr<const std::unordered_set<std::string>> constants;
 
-            std::unordered_set<std::string> instructions{};
-            std::unordered_set<std::string> macros{};
-            std::unordered_set<std::string> ports{};
+            std::shared_ptr<const std::unordered_set<std::string>> instructions;
+            std::shared_ptr<const std::unordered_set<std::string>> macros;
+            std::shared_ptr<const std::unordered_set<std::string>> ports;
 
             uint16_t bits = 8;
 
+            static void addDefinitionLine(std::vector<urcl::line_number>& rows, urcl::line_number row);
             static int iFindNthOperand(const std::vector<urcl::token>& code, unsigned int operand);
             static const token *findNthOperand(const std::vector<token>& code, unsigned int operand);
             static size_t columnToIdx(const std::vector<urcl::token>& line, unsigned int column);
@@ -62,11 +170,26 @@ namespace urcl {
             bool tokenIsBlank(const urcl::token& token, const urcl::source& original) const;
             bool tokenIsR0(const urcl::token& token, const urcl::source& original) const;
             const urcl::token *getBaseToken(const urcl::token& token, const urcl::source& original) const;
+            urcl::define_result resolveDefine(const urcl::token& token, const urcl::source& original, const urcl::token *&result) const;
+            static const urcl::token *getDefineValue(const urcl::token& token, const urcl::source& original);
 
             std::vector<token> parseLine(const std::string& line, bool& inComment, const urcl::config& config) const;
             int resolveTokenType(bool inUir, const urcl::token& token, const urcl::source& original, const std::unordered_set<std::string>& constants) const;
+            static int lexedTokenType(bool inUir, const urcl::token& token);
 
-            void updateDefinitions(urcl::source& code, const std::filesystem::path& loc, bool base);
+            void updateIncludeDefinitions(const urcl::source& include, const std::filesystem::path& loc);
+            void addDefinition(urcl::line_number row);
+            void removeDefinition(urcl::line_number row);
+            void addObject(urcl::sub_object type, urcl::line_number row);
+            void shiftDefinitions(urcl::line_number from, int64_t delta);
+            void resolveDefinition(const std::string& name, const std::filesystem::path& loc);
+            void updateObjects();
+            void addDefinitionError(urcl::line_number row, const std::string& error, bool replace);
+            void clearDefinitionErrors(urcl::line_number row);
+            void markChangedDefinitions();
+            void resolveDefines();
+            void checkLine(urcl::line_number row, const urcl::config& config);
+            urcl::object_id objectAt(urcl::line_number row) const;
     };
 }
 
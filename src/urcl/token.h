@@ -1,6 +1,7 @@
 #ifndef TOKEN_H
 #define TOKEN_H
 
+#include <cstdint>
 #include <string>
 
 namespace urcl {
@@ -36,6 +37,8 @@ namespace urcl {
             std::string parse_error;
             std::string parse_warning;
             uint32_t column;
+            uint32_t length = 0; // in UTF-16 code units, the way the editor counts columns
+            int8_t semantic = -1; // index into the semantic token legend, -1 when it isn't highlighted
     };
 }
 
@@ -8,14 +8,15 @@
 #include <cmath>
 #include <string_view>
 
-size_t util::utf8len(const char* str) {
+size_t util::utf8len(std::string_view str) {
+    // stops at a null like the C string it used to take, and at the end of the view when a sequence is cut short
     size_t len = 0;
-    for (; *str != 0; ++len) {
-        int v01 = ((*str & 0x80) >> 7) & ((*str & 0x40) >> 6);
-        int v2 = (*str & 0x20) >> 5;
-        int v3 = (*str & 0x10) >> 4;
+    for (size_t i = 0; i < str.length() && str[i] != 0; ++len) {
+        int v01 = ((str[i] & 0x80) >> 7) & ((str[i] & 0x40) >> 6);
+        int v2 = (str[i] & 0x20) >> 5;
+        int v3 = (str[i] & 0x10) >> 4;
         if (v01 && v3) ++len;
-        str += 1 + ((v01 << v2) | (v01 & v3));
+        i += 1 + ((v01 << v2) | (v01 & v3));
     }
     return len;
 }
@@ -53,23 +54,23 @@ bool util::isfdigit(char c) {
     return isdigit(c) || c == '.' || c == 'e' || c == 'E' || c == '-' || c == '+';
 }
 
-bool util::isNumber(const std::string& s) {
+bool util::isNumber(std::string_view s) {
     return !s.empty() && std::all_of(s.begin(), s.end(), isdigit);
 }
 
-bool util::isOctal(const std::string& s) {
+bool util::isOctal(std::string_view s) {
     return !s.empty() && std::all_of(s.begin(), s.end(), util::isodigit);
 }
 
-bool util::isBinary(const std::string& s) {
+bool util::isBinary(std::string_view s) {
     return !s.empty() && std::all_of(s.begin(), s.end(), util::isbdigit);
 }
 
-bool util::isHex(const std::string& s) {
+bool util::isHex(std::string_view s) {
     return !s.empty() && std::all_of(s.begin(), s.end(), isxdigit);
 }
 
-bool util::isFloat(const std::string& s) {
+bool util::isFloat(std::string_view s) {
     if (s.find('.') != s.rfind('.')) return false;
     if (s.find_first_of("eE") != s.find_last_of("eE")) return false;
     if (s.find_first_of("-+") != s.find_last_of("-+")) return false;
@@ -258,3 +259,60 @@ std::string util::intHover(int64_t numb, uint32_t bits, bool iris) {
     }
     return result;
 }
+
+std::optional<std::string_view> util::jsonMember(std::string_view json, std::string_view name) {
+    int depth = 0;
+    bool inString = false;
+    size_t keyStart = 0;
+    std::string_view key;
+    for (size_t i = 0; i < json.length(); ++i) {
+        char c = json[i];
+        if (inString) {
+            if (c == '\\') {
+                ++i;
+            } else if (c == '"') {
+                inString = false;
+                if (depth == 1) key = json.substr(keyStart, i - keyStart);
+            }
+            continue;
+        }
+        if (c == '"') {
+            inString = true;
+            keyStart = i + 1;
+        } else if (c == '{' || c == '[') {
+            ++depth;
+        } else if (c == '}' || c == ']') {
+            --depth;
+        } else if (c == ',') {
+            key = {};
+        } else if (c == ':' && depth == 1 && key == name) {
+            size_t start = json.find_first_not_of(" \t\r\n", i + 1);
+            if (start == std::string_view::npos) return {};
+            // the value ends at the first separator that isn't inside a string, object or array
+            size_t end = start;
+            int nesting = 0;
+            bool quoted = false;
+            for (; end < json.length(); ++end) {
+                char v = json[end];
+                if (quoted) {
+                    if (v == '\\') {
+                        ++end;
+                    } else if (v == '"') {
+                        quoted = false;
+                    }
+                } else if (v == '"') {
+                    quoted = true;
+                } else if (v == '{' || v == '[') {
+                    ++nesting;
+                } else if (v == '}' || v == ']') {
+                    if (nesting-- == 0) break;
+                } else if (v == ',' && nesting == 0) {
+                    break;
+                }
+            }
+            std::string_view value = json.substr(start, std::min(end, json.length()) - start);
+            return value.substr(0, value.find_last_not_of(" \t\r\n") + 1);
+        }
+    }
+    return {};
+}
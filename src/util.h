@@ -1,12 +1,13 @@
 #ifndef UTIL_H
 #define UTIL_H
 
+#include <optional>
 #include <string>
 #include <string_view>
 #include <cstdint>
 
 namespace util {
-    size_t utf8len(const char* str);
+    size_t utf8len(std::string_view str);
 
     size_t utf16index(std::string_view str, size_t idx);
 
@@ -18,15 +19,15 @@ namespace util {
 
     bool isfdigit(char c);
 
-    bool isNumber(const std::string& s);
+    bool isNumber(std::string_view s);
 
-    bool isOctal(const std::string& s);
+    bool isOctal(std::string_view s);
 
-    bool isBinary(const std::string& s);
+    bool isBinary(std::string_view s);
 
-    bool isHex(const std::string& s);
+    bool isHex(std::string_view s);
 
-    bool isFloat(const std::string& s);
+    bool isFloat(std::string_view s);
 
     std::string trim(const std::string& str);
 
@@ -47,6 +48,9 @@ namespace util {
     std::string intHover(int64_t numb, uint32_t bits, bool iris);
 
     std::string divideBits(uint32_t bits, uint32_t divisor);
+
+    // raw text of a top level member of a JSON object, strings keep their quotes
+    std::optional<std::string_view> jsonMember(std::string_view json, std::string_view name);
 }
 
 #endif
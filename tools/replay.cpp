@@ -0,0 +1,228 @@
+// Replays a session recorded with `urcl-lsp --record <file>` against a server
+// started as a child process, then reports per-method latency and peak RSS.
+// usage: urcl-lsp-replay [--speed <factor>] <recording> <server> [server arguments...]
+// a speed of 0 sends every message as soon as the previous one is written.
+
+#include "../src/util.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <map>
+#include <mutex>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+#include <signal.h>
+#include <sys/resource.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+using clock_type = std::chrono::steady_clock;
+
+struct message {
+    double time; // milliseconds since recording started
+    std::string body;
+};
+
+static bool writeAll(int fd, std::string_view data) {
+    while (!data.empty()) {
+        ssize_t written = ::write(fd, data.data(), data.length());
+        if (written <= 0) return false;
+        data.remove_prefix(written);
+    }
+    return true;
+}
+
+static bool send(int fd, std::string_view body) {
+    return writeAll(fd, "Content-Length: " + std::to_string(body.length()) + "\r\n\r\n" + std::string(body));
+}
+
+static bool readExact(int fd, char *buffer, size_t length) {
+    while (length > 0) {
+        ssize_t count = ::read(fd, buffer, length);
+        if (count <= 0) return false;
+        buffer += count;
+        length -= count;
+    }
+    return true;
+}
+
+static std::optional<std::string> readMessage(int fd) {
+    std::string header;
+    size_t length = 0;
+    while (!header.ends_with("\r\n\r\n")) {
+        char c;
+        if (!readExact(fd, &c, 1)) return {};
+        header += c;
+        if (header.ends_with("\r\n")) {
+            size_t start = header.rfind("\r\n", header.length() - 3);
+            start = start == std::string::npos ? 0 : start + 2;
+            std::string_view line = std::string_view(header).substr(start);
+            if (line.starts_with("Content-Length:")) length = std::stoul(std::string(line.substr(15)));
+        }
+    }
+    std::string body(length, '\0');
+    if (!readExact(fd, body.data(), length)) return {};
+    return body;
+}
+
+static std::vector<message> load(const char *file) {
+    std::vector<message> result;
+    std::ifstream in(file, std::ios::binary);
+    double time;
+    size_t length;
+    while (in >> time >> length) {
+        in.get();
+        std::string body(length, '\0');
+        if (!in.read(body.data(), length)) break;
+        in.get();
+        result.push_back({time, std::move(body)});
+    }
+    return result;
+}
+
+static double percentile(const std::vector<double>& sorted, double fraction) {
+    size_t index = std::min(sorted.size() - 1, static_cast<size_t>(fraction * (sorted.size() - 1) + 0.5));
+    return sorted[index];
+}
+
+int main(int argc, char *argv[]) {
+    double speed = 1;
+    int arg = 1;
+    if (arg + 1 < argc && !strcmp(argv[arg], "--speed")) {
+        speed = std::strtod(argv[arg + 1], nullptr);
+        arg += 2;
+    }
+    if (argc - arg < 2) {
+        std::fprintf(stderr, "usage: %s [--speed <factor>] <recording> <server> [server arguments...]\n", argv[0]);
+        return 2;
+    }
+    std::vector<message> messages = load(argv[arg]);
+    if (messages.empty()) {
+        std::fprintf(stderr, "%s: no messages in %s\n", argv[0], argv[arg]);
+        return 1;
+    }
+
+    int toServer[2];
+    int fromServer[2];
+    if (pipe(toServer) != 0 || pipe(fromServer) != 0) {
+        std::perror("pipe");
+        return 1;
+    }
+    signal(SIGPIPE, SIG_IGN);
+    pid_t child = fork();
+    if (child < 0) {
+        std::perror("fork");
+        return 1;
+    }
+    if (child == 0) {
+        dup2(toServer[0], STDIN_FILENO);
+        dup2(fromServer[1], STDOUT_FILENO);
+        close(toServer[0]);
+        close(toServer[1]);
+        close(fromServer[0]);
+        close(fromServer[1]);
+        execvp(argv[arg + 1], argv + arg + 1);
+        std::perror("exec");
+        _exit(127);
+    }
+    close(toServer[0]);
+    close(fromServer[1]);
+
+    std::mutex mutex;
+    // request id -> method and when it was sent
+    std::unordered_map<std::string, std::pair<std::string, clock_type::time_point>> outstanding;
+    std::map<std::string, std::vector<double>> latencies;
+    size_t notifications = 0;
+
+    std::thread reader([&] {
+        while (std::optional<std::string> body = readMessage(fromServer[0])) {
+            clock_type::time_point now = clock_type::now();
+            std::optional<std::string_view> id = util::jsonMember(*body, "id");
+            std::optional<std::string_view> method = util::jsonMember(*body, "method");
+            std::lock_guard<std::mutex> lock(mutex);
+            if (method.has_value()) {
+                if (id.has_value()) {
+                    // requests from the server, e.g. client/registerCapability, get an empty result
+                    std::string response = "{\"jsonrpc\":\"2.0\",\"id\":" + std::string(*id) + ",\"result\":null}";
+                    send(toServer[1], response);
+                } else {
+                    ++notifications;
+                }
+                continue;
+            }
+            if (!id.has_value() || !outstanding.contains(std::string(*id))) continue;
+            std::pair<std::string, clock_type::time_point> sent = outstanding.at(std::string(*id));
+            outstanding.erase(std::string(*id));
+            latencies[sent.first].push_back(std::chrono::duration<double, std::milli>(now - sent.second).count());
+        }
+    });
+
+    clock_type::time_point start = clock_type::now();
+    bool sentExit = false;
+    for (const message& current : messages) {
+        std::optional<std::string_view> method = util::jsonMember(current.body, "method");
+        // responses the editor sent to server requests are answered by the reader instead
+        if (!method.has_value()) continue;
+        if (speed > 0) {
+            std::this_thread::sleep_until(start + std::chrono::duration_cast<clock_type::duration>(std::chrono::duration<double, std::milli>(current.time / speed)));
+        }
+        std::optional<std::string_view> id = util::jsonMember(current.body, "id");
+        std::string name = std::string(method->substr(1, method->length() - 2));
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            if (id.has_value()) outstanding[std::string(*id)] = {name, clock_type::now()};
+            send(toServer[1], current.body);
+        }
+        if (name == "exit") {
+            sentExit = true;
+            break;
+        }
+    }
+    if (!sentExit) {
+        // let the last responses arrive before asking the server to stop
+        for (int i = 0; i < 100; ++i) {
+            {
+                std::lock_guard<std::mutex> lock(mutex);
+                if (outstanding.empty()) break;
+            }
+            std::this_thread::sleep_for(std::chrono::milliseconds(50));
+        }
+        std::lock_guard<std::mutex> lock(mutex);
+        send(toServer[1], "{\"jsonrpc\":\"2.0\",\"id\":\"replay\",\"method\":\"shutdown\"}");
+        send(toServer[1], "{\"jsonrpc\":\"2.0\",\"method\":\"exit\"}");
+    }
+    close(toServer[1]);
+
+    int status;
+    waitpid(child, &status, 0);
+    reader.join();
+    close(fromServer[0]);
+    struct rusage usage;
+    getrusage(RUSAGE_CHILDREN, &usage);
+
+    std::printf("%-40s %8s %10s %10s %10s %10s\n", "method", "count", "p50 ms", "p95 ms", "p99 ms", "max ms");
+    for (std::pair<const std::string, std::vector<double>>& method : latencies) {
+        std::vector<double>& times = method.second;
+        std::sort(times.begin(), times.end());
+        std::printf("%-40s %8zu %10.3f %10.3f %10.3f %10.3f\n", method.first.c_str(), times.size(),
+                    percentile(times, 0.5), percentile(times, 0.95), percentile(times, 0.99), times.back());
+    }
+    std::printf("notifications from server: %zu\n", notifications);
+    std::printf("unanswered requests: %zu\n", outstanding.size());
+    // kilobytes on Linux, bytes on macOS
+#ifdef __APPLE__
+    std::printf("peak rss: %.1f MiB\n", usage.ru_maxrss / (1024.0 * 1024.0));
+#else
+    std::printf("peak rss: %.1f MiB\n", usage.ru_maxrss / 1024.0);
+#endif
+    return WIFEXITED(status) ? WEXITSTATUS(status) : 1;
+}